@@ -19,18 +19,51 @@ obj-y += $(addprefix dirtrav/, $(dirtrav-obj-y))
 
 rbtree-obj-y :=
 rbtree-obj-y += rbtree.o
+rbtree-obj-y += rbtree_rcu.o
+rbtree-obj-y += rbtree_interval.o
+rbtree-obj-y += rbtree_ost.o
 obj-y += $(addprefix rbtree/, $(rbtree-obj-y))
 
 fifobuf-obj-y :=
 fifobuf-obj-y += fifobuf.o
+fifobuf-obj-y += fifobuf_cc.o
 obj-y += $(addprefix fifobuf/, $(fifobuf-obj-y))
 
 ctrie-obj-y :=
 ctrie-obj-y += ctrie.o
 obj-y += $(addprefix ctrie/, $(ctrie-obj-y))
 
+ringbuf-obj-y :=
+ringbuf-obj-y += ringbuf.o
+ringbuf-obj-y += ringbuf_lf.o
+obj-y += $(addprefix ringbuf/, $(ringbuf-obj-y))
+
+btree-obj-y :=
+btree-obj-y += btree.o
+obj-y += $(addprefix btree/, $(btree-obj-y))
+
+hashtab-obj-y :=
+hashtab-obj-y += hashtab.o
+obj-y += $(addprefix hashtab/, $(hashtab-obj-y))
+
+lfqueue-obj-y :=
+lfqueue-obj-y += mpmcq.o
+lfqueue-obj-y += mpscq.o
+obj-y += $(addprefix lfqueue/, $(lfqueue-obj-y))
+
 logmsg-obj-y :=
 logmsg-obj-y += logmsg.o
 obj-y += $(addprefix logmsg/, $(logmsg-obj-y))
 
+#; Benchmarks. Built by 'make bench', not part of the library.
+bench-y :=
+bench-y += fifobuf/fifobuf_bench
+fifobuf/fifobuf_bench: BENCH_LDFLAGS += -Wl,--wrap=malloc
+bench-y += btree/btree_bench
+bench-y += rbtree/rbtree_aug_bench
+bench-y += rbtree/rbtree_test
+bench-y += flatmap/flatmap_bench
+bench-y += lfqueue/lfqueue_bench
+bench-y += ringbuf/ringbuf_lf_bench
+
 #;
@@ -9,10 +9,20 @@
  * @details Apply userspace-rcu (uatomic) if this cannot work.
  */
 
-/* Check GCC version, just to be safe */
-#if !defined(__GNUC__) || (__GNUC__ < 4) || (__GNUC_MINOR__ < 1)
-# error atomic.h works only with GCC newer than version 4.1
-#endif /* GNUC >= 4.1 */
+/*
+ * Check for the __atomic builtins (GCC 4.7, clang 3.1), just to be safe.
+ * The legacy __sync ops below date from GCC 4.1.
+ */
+#if !defined(__GNUC__) || !defined(__ATOMIC_RELAXED)
+# error atomic.h works only with GCC newer than version 4.7
+#endif /* __ATOMIC_RELAXED */
+
+/* The kernel-style names below clash with the C11 generic macros. */
+#if defined(atomic_fetch_add)
+# error atomic.h cannot be used together with <stdatomic.h>
+#endif /* stdatomic.h */
+
+#include <stdint.h>
 
 /**
  * Atomic type.
@@ -137,4 +147,211 @@ static inline int atomic_add_negative( int i, atomic_t *v )
 	return (__sync_add_and_fetch(&v->counter, i) < 0);
 }
 
+/*
+ * Memory-ordered operations on __atomic builtins.
+ *
+ * The __sync ops above are always full barriers. The ops below follow the
+ * kernel naming: no suffix is fully ordered, _relaxed is atomic but orders
+ * nothing, _acquire orders later accesses after it, _release orders earlier
+ * accesses before it. A statistics counter wants _relaxed; a flag that
+ * publishes data wants a _release store paired with an _acquire load.
+ *
+ * For atomic_t, atomic64_t ("atomic" below) and all four orders:
+ *   atomic_add_return(i, v), atomic_sub_return(i, v)   return the new value
+ *   atomic_fetch_add(i, v), atomic_fetch_sub(i, v),
+ *   atomic_fetch_or(i, v), atomic_fetch_and(i, v)       return the old value
+ *   atomic_xchg(v, new)                                  return the old value
+ *   atomic_cmpxchg(v, old, new)                          return the old value
+ *   atomic_try_cmpxchg(v, &old, new)  return true if swapped, else load *old
+ * atomic_ptr_t has xchg and cmpxchg only. Plain fields shared between threads
+ * use READ_ONCE()/WRITE_ONCE(), smp_load_acquire() and smp_store_release().
+ */
+
+/**
+ * Read with acquire semantics
+ * @param v pointer of type atomic_t
+ */
+#define atomic_read_acquire(v) __atomic_load_n(&(v)->counter, __ATOMIC_ACQUIRE)
+
+/**
+ * Set with release semantics
+ * @param v pointer of type atomic_t
+ * @param i required value
+ */
+#define atomic_set_release(v,i) __atomic_store_n(&(v)->counter, (i), __ATOMIC_RELEASE)
+
+/**
+ * Full memory barrier
+ */
+#define smp_mb() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/**
+ * Read (write) memory barrier: loads (stores) before it are ordered before
+ * loads (stores) after it. Done by acquire (release) fences, a bit stronger
+ */
+#define smp_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+
+/**
+ * Load or store a plain variable once: not torn, not merged nor repeated by
+ * the compiler, but not ordered either
+ * @param x a naturally aligned scalar
+ */
+#define READ_ONCE(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x,v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+/**
+ * Load a plain variable with acquire semantics
+ * @param p pointer to a naturally aligned scalar
+ */
+#define smp_load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+
+/**
+ * Store a plain variable with release semantics
+ * @param p pointer to a naturally aligned scalar
+ * @param v value to store
+ */
+#define smp_store_release(p,v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/**
+ * 64-bit atomic type. Aligned so 32-bit targets stay lock-free.
+ */
+typedef struct {
+	volatile int64_t counter __attribute__((aligned(8)));
+} atomic64_t;
+
+#define ATOMIC64_INIT(i)  { (i) }
+
+/**
+ * Read 64-bit atomic variable. Does not tear on 32-bit targets.
+ * @param v pointer of type atomic64_t
+ */
+#define atomic64_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic64_read_acquire(v) __atomic_load_n(&(v)->counter, __ATOMIC_ACQUIRE)
+
+/**
+ * Set 64-bit atomic variable
+ * @param v pointer of type atomic64_t
+ * @param i required value
+ */
+#define atomic64_set(v,i) __atomic_store_n(&(v)->counter, (i), __ATOMIC_RELAXED)
+#define atomic64_set_release(v,i) __atomic_store_n(&(v)->counter, (i), __ATOMIC_RELEASE)
+
+/**
+ * Atomic pointer type.
+ */
+typedef struct {
+	void *volatile ptr;
+} atomic_ptr_t;
+
+#define ATOMIC_PTR_INIT(p)  { (p) }
+
+/**
+ * Read or set atomic pointer
+ * @param v pointer of type atomic_ptr_t
+ */
+#define atomic_ptr_read(v) __atomic_load_n(&(v)->ptr, __ATOMIC_RELAXED)
+#define atomic_ptr_read_acquire(v) __atomic_load_n(&(v)->ptr, __ATOMIC_ACQUIRE)
+#define atomic_ptr_set(v,p) __atomic_store_n(&(v)->ptr, (p), __ATOMIC_RELAXED)
+#define atomic_ptr_set_release(v,p) __atomic_store_n(&(v)->ptr, (p), __ATOMIC_RELEASE)
+
+/*
+ * Generators. Each gen() is instantiated once per order as
+ * gen(suffix, order, failure order of a cmpxchg, ...).
+ */
+#define ATOMIC_GEN_ORDERS(gen, ...) \
+	gen(, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST, __VA_ARGS__) \
+	gen(_relaxed, __ATOMIC_RELAXED, __ATOMIC_RELAXED, __VA_ARGS__) \
+	gen(_acquire, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE, __VA_ARGS__) \
+	gen(_release, __ATOMIC_RELEASE, __ATOMIC_RELAXED, __VA_ARGS__)
+
+#define ATOMIC_GEN_OP_RETURN(sfx, order, fail, pfx, type, op) \
+static inline type pfx##_##op##_return##sfx( type i, pfx##_t *v ) \
+{ \
+	return __atomic_##op##_fetch(&v->counter, i, order); \
+}
+
+#define ATOMIC_GEN_FETCH_OP(sfx, order, fail, pfx, type, op) \
+static inline type pfx##_fetch_##op##sfx( type i, pfx##_t *v ) \
+{ \
+	return __atomic_fetch_##op(&v->counter, i, order); \
+}
+
+#define ATOMIC_GEN_XCHG(sfx, order, fail, pfx, type, member) \
+static inline type pfx##_xchg##sfx( pfx##_t *v, type n ) \
+{ \
+	return __atomic_exchange_n(&v->member, n, order); \
+} \
+static inline int pfx##_try_cmpxchg##sfx( pfx##_t *v, type *old, type n ) \
+{ \
+	return __atomic_compare_exchange_n(&v->member, old, n, 0, order, fail); \
+} \
+static inline type pfx##_cmpxchg##sfx( pfx##_t *v, type old, type n ) \
+{ \
+	(void)pfx##_try_cmpxchg##sfx(v, &old, n); \
+	return old; \
+}
+
+#define ATOMIC_GEN_OPS(pfx, type) \
+	ATOMIC_GEN_ORDERS(ATOMIC_GEN_OP_RETURN, pfx, type, add) \
+	ATOMIC_GEN_ORDERS(ATOMIC_GEN_OP_RETURN, pfx, type, sub) \
+	ATOMIC_GEN_ORDERS(ATOMIC_GEN_FETCH_OP, pfx, type, add) \
+	ATOMIC_GEN_ORDERS(ATOMIC_GEN_FETCH_OP, pfx, type, sub) \
+	ATOMIC_GEN_ORDERS(ATOMIC_GEN_FETCH_OP, pfx, type, or) \
+	ATOMIC_GEN_ORDERS(ATOMIC_GEN_FETCH_OP, pfx, type, and) \
+	ATOMIC_GEN_ORDERS(ATOMIC_GEN_XCHG, pfx, type, counter)
+
+ATOMIC_GEN_OPS(atomic, int)
+ATOMIC_GEN_OPS(atomic64, int64_t)
+ATOMIC_GEN_ORDERS(ATOMIC_GEN_XCHG, atomic_ptr, void *, ptr)
+
+#undef ATOMIC_GEN_OPS
+#undef ATOMIC_GEN_XCHG
+#undef ATOMIC_GEN_FETCH_OP
+#undef ATOMIC_GEN_OP_RETURN
+#undef ATOMIC_GEN_ORDERS
+
+/*
+ * atomic64_t counterparts of the atomic_t ops above, fully ordered likewise.
+ */
+static inline void atomic64_add( int64_t i, atomic64_t *v )
+{
+	(void)atomic64_add_return(i, v);
+}
+
+static inline void atomic64_sub( int64_t i, atomic64_t *v )
+{
+	(void)atomic64_sub_return(i, v);
+}
+
+static inline void atomic64_inc( atomic64_t *v )
+{
+	(void)atomic64_add_return(1, v);
+}
+
+static inline void atomic64_dec( atomic64_t *v )
+{
+	(void)atomic64_sub_return(1, v);
+}
+
+static inline int atomic64_sub_and_test( int64_t i, atomic64_t *v )
+{
+	return !atomic64_sub_return(i, v);
+}
+
+static inline int atomic64_dec_and_test( atomic64_t *v )
+{
+	return !atomic64_sub_return(1, v);
+}
+
+static inline int atomic64_inc_and_test( atomic64_t *v )
+{
+	return !atomic64_add_return(1, v);
+}
+
+static inline int atomic64_add_negative( int64_t i, atomic64_t *v )
+{
+	return (atomic64_add_return(i, v) < 0);
+}
+
 #endif /* SRC_LGU_ATOMIC_ATOMIC_H_ */
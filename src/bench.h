@@ -0,0 +1,76 @@
+/*!
+ * \file bench.h
+ * \brief Helpers shared by the benchmarks built by 'make bench'.
+ *
+ * \details
+ * A benchmark takes a few optional numeric arguments, runs, and prints one
+ * CSV line per case to stdout after a header line, so that results of two
+ * commits can be compared by a script.
+ *
+ * \par Example:
+ * \code
+loops = bench_arg(argc, argv, 1, PERF_LOOPS);
+nr_nodes = bench_arg(argc, argv, 2, NODES);
+if (loops == 0 || nr_nodes == 0)
+	return bench_usage(argv[0], "[perf_loops [nodes]]");
+
+printf("tree,op,nodes,loops,ns_per_op\n");
+t = bench_now_ns();
+...
+bench_print_result("rbtree", "insert", bench_now_ns() - t, nr_nodes, loops);
+ * \endcode
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_STR_(x) #x
+#define BENCH_STR(x) BENCH_STR_(x) //!< A numeric define as a string, e.g. for usage
+
+/*!
+ * \brief Monotonic time in ns.
+ */
+static inline uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*!
+ * \brief Get a numeric argument.
+ * \param i Position of the argument, from 1
+ * \param dfl Value if not given
+ */
+static inline unsigned long bench_arg(int argc, char **argv, int i, unsigned long dfl)
+{
+	return argc > i ? strtoul(argv[i], NULL, 0) : dfl;
+}
+
+/*!
+ * \brief Print usage to stderr.
+ * \return 1, the exit code of main()
+ */
+static inline int bench_usage(const char *prog, const char *args)
+{
+	fprintf(stderr, "Usage: %s %s\n", prog, args);
+	return 1;
+}
+
+/*!
+ * \brief Print a "name,op,nodes,loops,ns_per_op" CSV line.
+ * \param ns Time spent on nodes ops, loops times
+ */
+static inline void bench_print_result(const char *name, const char *op, const uint64_t ns,
+	const unsigned int nodes, const unsigned int loops)
+{
+	printf("%s,%s,%u,%u,%.1f\n", name, op, nodes, loops, (double) ns / ((double) loops * nodes));
+}
+
+#endif /* BENCH_H_ */
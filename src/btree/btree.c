@@ -0,0 +1,680 @@
+/*!
+ * \file btree.c
+ * \brief Keyed B+-tree with cache-line-sized nodes.
+ *
+ * \sa btree.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "btree.h"
+
+#define BTREE_LEAF_MIN (BTREE_LEAF_MAX / 2)
+#define BTREE_INNER_MIN (BTREE_INNER_MAX / 2)
+
+/*
+ * A descent from root to leaf. idx[l] is the child index taken at level l.
+ * Level 0 is the root.
+ */
+struct btree_path
+{
+	void *node[BTREE_HEIGHT_MAX];
+	unsigned int idx[BTREE_HEIGHT_MAX];
+};
+
+static void *btree_node_alloc(void)
+{
+	void *node;
+
+	if (posix_memalign(&node, BTREE_CACHELINE, BTREE_NODE_SIZE))
+	{
+		return NULL;
+	}
+
+	return node;
+}
+
+#define btree_node_free(_node) free(_node)
+
+/*
+ * First index i with key[i] >= key. (nr if none)
+ *
+ * A node is at most a few cache lines, so count linearly without branches
+ * instead of a binary search which mispredicts on every step.
+ */
+static inline unsigned int btree_lower_bound(const uint64_t *keys, const unsigned int nr, const uint64_t key)
+{
+	unsigned int i, pos = 0;
+
+	for (i = 0; i < nr; i++)
+	{
+		pos += (keys[i] < key);
+	}
+
+	return pos;
+}
+
+/*
+ * Child index to descend: first i with key < keys[i]. (nr if none)
+ */
+static inline unsigned int btree_inner_find(const struct btree_inner *inner, const uint64_t key)
+{
+	unsigned int i, pos = 0;
+
+	for (i = 0; i < inner->nr; i++)
+	{
+		pos += (inner->key[i] <= key);
+	}
+
+	return pos;
+}
+
+/*
+ * Fetch all cache lines of a node at once, instead of one miss after another
+ * while scanning its keys and then its children.
+ */
+static inline void btree_prefetch_node(const void *node)
+{
+	unsigned int off;
+
+	for (off = 0; off < BTREE_NODE_SIZE; off += BTREE_CACHELINE)
+	{
+		__builtin_prefetch((const uint8_t *) node + off);
+	}
+}
+
+static struct btree_leaf *btree_descend(const struct btree_root *root, const uint64_t key, struct btree_path *path)
+{
+	void *node = root->node;
+	unsigned int level, idx;
+
+	for (level = 0; level + 1 < root->height; level++)
+	{
+		idx = btree_inner_find((struct btree_inner *) node, key);
+
+		if (path)
+		{
+			path->node[level] = node;
+			path->idx[level] = idx;
+		}
+
+		node = ((struct btree_inner *) node)->child[idx];
+		btree_prefetch_node(node);
+	}
+
+	if (path)
+	{
+		path->node[level] = node;
+	}
+
+	return (struct btree_leaf *) node;
+}
+
+/*!
+ * \brief Find the value of key.
+ * \return The value
+ * \return NULL if key is not found
+ */
+extern void *btree_lookup(const struct btree_root *root, uint64_t key)
+{
+	struct btree_leaf *leaf;
+	unsigned int pos;
+
+	if (root->node == NULL)
+	{
+		return NULL;
+	}
+
+	leaf = btree_descend(root, key, NULL);
+
+	pos = btree_lower_bound(leaf->key, leaf->nr, key);
+	if (pos < leaf->nr && leaf->key[pos] == key)
+	{
+		return leaf->val[pos];
+	}
+
+	return NULL;
+}
+
+static inline void btree_leaf_insert_at(struct btree_leaf *leaf, const unsigned int pos, const uint64_t key, void *val)
+{
+	memmove(&leaf->key[pos + 1], &leaf->key[pos], (leaf->nr - pos) * sizeof(leaf->key[0]));
+	memmove(&leaf->val[pos + 1], &leaf->val[pos], (leaf->nr - pos) * sizeof(leaf->val[0]));
+
+	leaf->key[pos] = key;
+	leaf->val[pos] = val;
+	leaf->nr++;
+}
+
+/*
+ * Insert key and child (right of key) at pos.
+ */
+static inline void btree_inner_insert_at(struct btree_inner *inner, const unsigned int pos, const uint64_t key, void *child)
+{
+	memmove(&inner->key[pos + 1], &inner->key[pos], (inner->nr - pos) * sizeof(inner->key[0]));
+	memmove(&inner->child[pos + 2], &inner->child[pos + 1], (inner->nr - pos) * sizeof(inner->child[0]));
+
+	inner->key[pos] = key;
+	inner->child[pos + 1] = child;
+	inner->nr++;
+}
+
+/*!
+ * \brief Insert a key.
+ * \return 0 if ok
+ * \return 1 if key already exists. The tree is unchanged.
+ * \return -1 if cannot alloc memory. The tree is unchanged.
+ */
+extern int btree_insert(struct btree_root *root, uint64_t key, void *val)
+{
+	struct btree_path path;
+	struct btree_leaf *leaf, *right;
+	struct btree_inner *inner, *inner_right;
+	void *spare[BTREE_HEIGHT_MAX + 1], *child;
+	unsigned int pos, level, nr_split, nr_spare, i;
+	uint64_t sep;
+
+	if (root->node == NULL)
+	{
+		leaf = btree_node_alloc();
+		if (leaf == NULL)
+		{
+			return -1;
+		}
+
+		leaf->prev = leaf->next = NULL;
+		leaf->nr = 0;
+		btree_leaf_insert_at(leaf, 0, key, val);
+
+		root->node = leaf;
+		root->height = 1;
+		root->nr = 1;
+		return 0;
+	}
+
+	leaf = btree_descend(root, key, &path);
+
+	pos = btree_lower_bound(leaf->key, leaf->nr, key);
+	if (pos < leaf->nr && leaf->key[pos] == key)
+	{
+		return 1;
+	}
+
+	if (leaf->nr < BTREE_LEAF_MAX)
+	{
+		btree_leaf_insert_at(leaf, pos, key, val);
+		root->nr++;
+		return 0;
+	}
+
+	/*
+	 * Count full nodes from leaf up, and alloc all new nodes first, so that
+	 * nothing is changed on failure. One more for a new root.
+	 */
+	level = root->height - 1;
+	nr_split = 1;
+	while (level > 0 && ((struct btree_inner *) path.node[level - 1])->nr == BTREE_INNER_MAX)
+	{
+		nr_split++;
+		level--;
+	}
+
+	nr_spare = nr_split + ((nr_split == root->height) ? 1 : 0);
+	if (root->height + 1 > BTREE_HEIGHT_MAX && nr_spare > nr_split)
+	{
+		return -1;
+	}
+
+	for (i = 0; i < nr_spare; i++)
+	{
+		spare[i] = btree_node_alloc();
+		if (spare[i] == NULL)
+		{
+			while (i--)
+			{
+				btree_node_free(spare[i]);
+			}
+			return -1;
+		}
+	}
+
+	/* Split leaf. The left half keeps the extra key of an odd count. */
+	right = spare[--nr_spare];
+	right->nr = (BTREE_LEAF_MAX + 1) / 2;
+	leaf->nr = BTREE_LEAF_MAX - right->nr;
+
+	memcpy(right->key, &leaf->key[leaf->nr], right->nr * sizeof(leaf->key[0]));
+	memcpy(right->val, &leaf->val[leaf->nr], right->nr * sizeof(leaf->val[0]));
+
+	right->prev = leaf;
+	right->next = leaf->next;
+	if (leaf->next)
+	{
+		leaf->next->prev = right;
+	}
+	leaf->next = right;
+
+	if (pos <= leaf->nr)
+	{
+		btree_leaf_insert_at(leaf, pos, key, val);
+	}
+	else
+	{
+		btree_leaf_insert_at(right, pos - leaf->nr, key, val);
+	}
+
+	sep = right->key[0];
+	child = right;
+
+	/* Push (sep, child) up. */
+	for (level = root->height - 1; level > 0; level--)
+	{
+		inner = (struct btree_inner *) path.node[level - 1];
+		pos = path.idx[level - 1];
+
+		if (inner->nr < BTREE_INNER_MAX)
+		{
+			btree_inner_insert_at(inner, pos, sep, child);
+			root->nr++;
+			return 0;
+		}
+
+		/*
+		 * Split inner. Insert first into a scratch of MAX + 1 keys, then the
+		 * middle key moves up.
+		 */
+		{
+			uint64_t key_tmp[BTREE_INNER_MAX + 1];
+			void *child_tmp[BTREE_INNER_MAX + 2];
+			unsigned int nr_left, nr_right;
+
+			memcpy(key_tmp, inner->key, pos * sizeof(key_tmp[0]));
+			key_tmp[pos] = sep;
+			memcpy(&key_tmp[pos + 1], &inner->key[pos], (BTREE_INNER_MAX - pos) * sizeof(key_tmp[0]));
+
+			memcpy(child_tmp, inner->child, (pos + 1) * sizeof(child_tmp[0]));
+			child_tmp[pos + 1] = child;
+			memcpy(&child_tmp[pos + 2], &inner->child[pos + 1], (BTREE_INNER_MAX - pos) * sizeof(child_tmp[0]));
+
+			nr_left = (BTREE_INNER_MAX + 1) / 2;
+			nr_right = BTREE_INNER_MAX - nr_left;
+
+			inner_right = spare[--nr_spare];
+
+			inner->nr = nr_left;
+			memcpy(inner->key, key_tmp, nr_left * sizeof(key_tmp[0]));
+			memcpy(inner->child, child_tmp, (nr_left + 1) * sizeof(child_tmp[0]));
+
+			inner_right->nr = nr_right;
+			memcpy(inner_right->key, &key_tmp[nr_left + 1], nr_right * sizeof(key_tmp[0]));
+			memcpy(inner_right->child, &child_tmp[nr_left + 1], (nr_right + 1) * sizeof(child_tmp[0]));
+
+			sep = key_tmp[nr_left];
+			child = inner_right;
+		}
+	}
+
+	/* Root is split. Grow a new root. */
+	inner = spare[--nr_spare];
+	inner->nr = 1;
+	inner->key[0] = sep;
+	inner->child[0] = root->node;
+	inner->child[1] = child;
+
+	root->node = inner;
+	root->height++;
+	root->nr++;
+	return 0;
+}
+
+/*
+ * Fix the underflow leaf parent->child[idx] by borrowing from or merging with a sibling.
+ */
+static void btree_leaf_rebalance(struct btree_inner *parent, unsigned int idx)
+{
+	struct btree_leaf *leaf = parent->child[idx], *left, *right;
+
+	if (idx > 0)
+	{
+		left = parent->child[idx - 1];
+		if (left->nr > BTREE_LEAF_MIN)
+		{
+			btree_leaf_insert_at(leaf, 0, left->key[left->nr - 1], left->val[left->nr - 1]);
+			left->nr--;
+			parent->key[idx - 1] = leaf->key[0];
+			return;
+		}
+	}
+
+	if (idx < parent->nr)
+	{
+		right = parent->child[idx + 1];
+		if (right->nr > BTREE_LEAF_MIN)
+		{
+			leaf->key[leaf->nr] = right->key[0];
+			leaf->val[leaf->nr] = right->val[0];
+			leaf->nr++;
+
+			right->nr--;
+			memmove(right->key, &right->key[1], right->nr * sizeof(right->key[0]));
+			memmove(right->val, &right->val[1], right->nr * sizeof(right->val[0]));
+			parent->key[idx] = right->key[0];
+			return;
+		}
+	}
+
+	/* Merge child[i + 1] into child[i]. */
+	if (idx > 0)
+	{
+		left = parent->child[idx - 1];
+		right = leaf;
+	}
+	else
+	{
+		left = leaf;
+		right = parent->child[idx + 1];
+	}
+
+	memcpy(&left->key[left->nr], right->key, right->nr * sizeof(right->key[0]));
+	memcpy(&left->val[left->nr], right->val, right->nr * sizeof(right->val[0]));
+	left->nr += right->nr;
+
+	left->next = right->next;
+	if (right->next)
+	{
+		right->next->prev = left;
+	}
+
+	idx = (idx > 0) ? idx - 1 : 0;
+	memmove(&parent->key[idx], &parent->key[idx + 1], (parent->nr - idx - 1) * sizeof(parent->key[0]));
+	memmove(&parent->child[idx + 1], &parent->child[idx + 2], (parent->nr - idx - 1) * sizeof(parent->child[0]));
+	parent->nr--;
+
+	btree_node_free(right);
+}
+
+/*
+ * Same as btree_leaf_rebalance, for inner nodes. Keys rotate through parent.
+ */
+static void btree_inner_rebalance(struct btree_inner *parent, unsigned int idx)
+{
+	struct btree_inner *inner = parent->child[idx], *left, *right;
+
+	if (idx > 0)
+	{
+		left = parent->child[idx - 1];
+		if (left->nr > BTREE_INNER_MIN)
+		{
+			memmove(&inner->key[1], inner->key, inner->nr * sizeof(inner->key[0]));
+			memmove(&inner->child[1], inner->child, (inner->nr + 1) * sizeof(inner->child[0]));
+			inner->key[0] = parent->key[idx - 1];
+			inner->child[0] = left->child[left->nr];
+			inner->nr++;
+
+			parent->key[idx - 1] = left->key[left->nr - 1];
+			left->nr--;
+			return;
+		}
+	}
+
+	if (idx < parent->nr)
+	{
+		right = parent->child[idx + 1];
+		if (right->nr > BTREE_INNER_MIN)
+		{
+			inner->key[inner->nr] = parent->key[idx];
+			inner->child[inner->nr + 1] = right->child[0];
+			inner->nr++;
+
+			parent->key[idx] = right->key[0];
+			memmove(right->key, &right->key[1], (right->nr - 1) * sizeof(right->key[0]));
+			memmove(right->child, &right->child[1], right->nr * sizeof(right->child[0]));
+			right->nr--;
+			return;
+		}
+	}
+
+	if (idx > 0)
+	{
+		idx--;
+	}
+
+	left = parent->child[idx];
+	right = parent->child[idx + 1];
+
+	/* left + separator + right */
+	left->key[left->nr] = parent->key[idx];
+	memcpy(&left->key[left->nr + 1], right->key, right->nr * sizeof(right->key[0]));
+	memcpy(&left->child[left->nr + 1], right->child, (right->nr + 1) * sizeof(right->child[0]));
+	left->nr += right->nr + 1;
+
+	memmove(&parent->key[idx], &parent->key[idx + 1], (parent->nr - idx - 1) * sizeof(parent->key[0]));
+	memmove(&parent->child[idx + 1], &parent->child[idx + 2], (parent->nr - idx - 1) * sizeof(parent->child[0]));
+	parent->nr--;
+
+	btree_node_free(right);
+}
+
+/*!
+ * \brief Remove a key.
+ * \return The value of removed key
+ * \return NULL if key is not found
+ */
+extern void *btree_erase(struct btree_root *root, uint64_t key)
+{
+	struct btree_path path;
+	struct btree_leaf *leaf;
+	struct btree_inner *inner;
+	unsigned int pos, level;
+	void *val;
+
+	if (root->node == NULL)
+	{
+		return NULL;
+	}
+
+	leaf = btree_descend(root, key, &path);
+
+	pos = btree_lower_bound(leaf->key, leaf->nr, key);
+	if (pos >= leaf->nr || leaf->key[pos] != key)
+	{
+		return NULL;
+	}
+
+	val = leaf->val[pos];
+
+	leaf->nr--;
+	memmove(&leaf->key[pos], &leaf->key[pos + 1], (leaf->nr - pos) * sizeof(leaf->key[0]));
+	memmove(&leaf->val[pos], &leaf->val[pos + 1], (leaf->nr - pos) * sizeof(leaf->val[0]));
+	root->nr--;
+
+	/* Separators may keep a removed key. It still routes correctly. */
+	level = root->height - 1;
+	if (level == 0)
+	{
+		if (leaf->nr == 0)
+		{
+			btree_node_free(leaf);
+			root->node = NULL;
+			root->height = 0;
+		}
+		return val;
+	}
+
+	if (leaf->nr >= BTREE_LEAF_MIN)
+	{
+		return val;
+	}
+
+	btree_leaf_rebalance(path.node[level - 1], path.idx[level - 1]);
+
+	for (level--; level > 0; level--)
+	{
+		inner = path.node[level];
+		if (inner->nr >= BTREE_INNER_MIN)
+		{
+			return val;
+		}
+
+		btree_inner_rebalance(path.node[level - 1], path.idx[level - 1]);
+	}
+
+	/* Shrink an empty root. */
+	inner = root->node;
+	if (inner->nr == 0)
+	{
+		root->node = inner->child[0];
+		root->height--;
+		btree_node_free(inner);
+	}
+
+	return val;
+}
+
+static void btree_destroy_node(void *node, const unsigned int height)
+{
+	struct btree_inner *inner = node;
+	unsigned int i;
+
+	if (height > 1)
+	{
+		for (i = 0; i <= inner->nr; i++)
+		{
+			btree_destroy_node(inner->child[i], height - 1);
+		}
+	}
+
+	btree_node_free(node);
+}
+
+/*!
+ * \brief Free all nodes. Values are not touched.
+ */
+extern void btree_destroy(struct btree_root *root)
+{
+	if (root->node)
+	{
+		btree_destroy_node(root->node, root->height);
+	}
+
+	*root = BTREE_ROOT;
+}
+
+/*!
+ * \brief Point iter at the smallest key.
+ * \return 1 if ok, 0 if the tree is empty.
+ */
+extern int btree_first(const struct btree_root *root, struct btree_iter *iter)
+{
+	void *node = root->node;
+	unsigned int level;
+
+	iter->leaf = NULL;
+	iter->pos = 0;
+
+	if (node == NULL)
+	{
+		return 0;
+	}
+
+	for (level = 1; level < root->height; level++)
+	{
+		node = ((struct btree_inner *) node)->child[0];
+	}
+
+	iter->leaf = node;
+	return 1;
+}
+
+/*!
+ * \brief Point iter at the largest key.
+ * \return 1 if ok, 0 if the tree is empty.
+ */
+extern int btree_last(const struct btree_root *root, struct btree_iter *iter)
+{
+	void *node = root->node;
+	unsigned int level;
+
+	iter->leaf = NULL;
+	iter->pos = 0;
+
+	if (node == NULL)
+	{
+		return 0;
+	}
+
+	for (level = 1; level < root->height; level++)
+	{
+		node = ((struct btree_inner *) node)->child[((struct btree_inner *) node)->nr];
+	}
+
+	iter->leaf = node;
+	iter->pos = iter->leaf->nr - 1;
+	return 1;
+}
+
+/*!
+ * \brief Point iter at the smallest key >= key.
+ * \return 1 if ok, 0 if there's no such key.
+ */
+extern int btree_seek(const struct btree_root *root, uint64_t key, struct btree_iter *iter)
+{
+	struct btree_leaf *leaf;
+
+	iter->leaf = NULL;
+	iter->pos = 0;
+
+	if (root->node == NULL)
+	{
+		return 0;
+	}
+
+	leaf = btree_descend(root, key, NULL);
+
+	iter->leaf = leaf;
+	iter->pos = btree_lower_bound(leaf->key, leaf->nr, key);
+	if (iter->pos == leaf->nr)
+	{
+		iter->leaf = leaf->next;
+		iter->pos = 0;
+	}
+
+	return btree_iter_valid(iter);
+}
+
+/*!
+ * \brief Move iter to the next key.
+ * \return 1 if ok, 0 if iter passes the last key.
+ */
+extern int btree_next(struct btree_iter *iter)
+{
+	if (++iter->pos >= iter->leaf->nr)
+	{
+		iter->leaf = iter->leaf->next;
+		iter->pos = 0;
+	}
+
+	return btree_iter_valid(iter);
+}
+
+/*!
+ * \brief Move iter to the previous key.
+ * \return 1 if ok, 0 if iter passes the first key.
+ */
+extern int btree_prev(struct btree_iter *iter)
+{
+	if (iter->pos == 0)
+	{
+		iter->leaf = iter->leaf->prev;
+		iter->pos = (iter->leaf) ? iter->leaf->nr - 1 : 0;
+	}
+	else
+	{
+		iter->pos--;
+	}
+
+	return btree_iter_valid(iter);
+}
@@ -0,0 +1,119 @@
+/*!
+ * \file btree.h
+ * \brief Keyed B+-tree with cache-line-sized nodes.
+ *
+ * \details
+ * An alternative to rbtree for large indexes. A lookup in an rbtree touches one
+ * node (one cache miss) per level, about log2(n) levels. Here each node holds up
+ * to BTREE_LEAF_MAX / BTREE_INNER_MAX keys in BTREE_NODE_SIZE bytes, so a
+ * million keys take 5-6 levels, and keys of a node are searched in cache.
+ *
+ *                       +-------------+
+ *                       | inner       |
+ *                       +-------------+
+ *                      /       |       \
+ *   +------+    +------+    +------+    +------+
+ *   | leaf | <> | leaf | <> | leaf | <> | leaf |   (key, val) pairs, sorted
+ *   +------+    +------+    +------+    +------+
+ *
+ * Keys are unique uint64_t. Values are user pointers, so objects stay where
+ * they are. Leaves are doubly linked for in-order and range iteration.
+ *
+ * Like rbtree, there is no lock inside. An iterator is invalidated by any
+ * btree_insert() or btree_erase().
+ *
+ * \par Example:
+ * \code
+struct btree_root root = BTREE_ROOT;
+struct btree_iter iter;
+
+btree_insert(&root, obj->id, obj);
+obj = btree_lookup(&root, id);
+
+// Visit [lo, hi]
+btree_for_each_range(&root, &iter, lo, hi)
+{
+	obj = btree_iter_val(&iter);
+}
+
+btree_erase(&root, id);
+btree_destroy(&root);
+ * \endcode
+ */
+
+#ifndef BTREE_H_
+#define BTREE_H_
+
+#include <stdint.h>
+
+#define BTREE_CACHELINE (64)
+#define BTREE_NODE_SIZE (256) //!< Bytes of a node. A multiple of BTREE_CACHELINE.
+
+#define BTREE_LEAF_MAX ((BTREE_NODE_SIZE - 2 * sizeof(void *) - sizeof(unsigned int)) / (sizeof(uint64_t) + sizeof(void *)))
+#define BTREE_INNER_MAX ((BTREE_NODE_SIZE - sizeof(unsigned int) - sizeof(void *)) / (sizeof(uint64_t) + sizeof(void *)))
+
+#define BTREE_HEIGHT_MAX (16) //!< At least (BTREE_LEAF_MAX / 2) ^ 16 keys. Enough.
+
+struct btree_leaf
+{
+	struct btree_leaf *prev;
+	struct btree_leaf *next;
+	unsigned int nr;
+	uint64_t key[BTREE_LEAF_MAX];
+	void *val[BTREE_LEAF_MAX];
+} __attribute__((aligned(BTREE_CACHELINE)));
+
+struct btree_inner
+{
+	unsigned int nr; //!< Number of keys. Number of children is nr + 1.
+	uint64_t key[BTREE_INNER_MAX]; //!< key[i] <= all keys under child[i + 1]
+	void *child[BTREE_INNER_MAX + 1];
+} __attribute__((aligned(BTREE_CACHELINE)));
+
+struct btree_root
+{
+	void *node; //!< A leaf if height is 1
+	unsigned int height; //!< 0 if empty
+	unsigned long nr; //!< Number of keys
+};
+
+#define BTREE_ROOT (struct btree_root) { NULL, 0, 0 }
+#define BTREE_EMPTY_ROOT(_root) ((_root)->node == NULL)
+
+/*!
+ * \brief A position in the tree. Valid if leaf is not NULL.
+ */
+struct btree_iter
+{
+	struct btree_leaf *leaf;
+	unsigned int pos;
+};
+
+#define btree_iter_valid(_iter) ((_iter)->leaf != NULL)
+#define btree_iter_key(_iter) ((_iter)->leaf->key[(_iter)->pos])
+#define btree_iter_val(_iter) ((_iter)->leaf->val[(_iter)->pos])
+
+extern int btree_insert(struct btree_root *root, uint64_t key, void *val);
+extern void *btree_erase(struct btree_root *root, uint64_t key);
+extern void *btree_lookup(const struct btree_root *root, uint64_t key);
+extern void btree_destroy(struct btree_root *root);
+
+/* In-order iteration. Each returns 0 and leaves iter invalid at the end. */
+extern int btree_first(const struct btree_root *root, struct btree_iter *iter);
+extern int btree_last(const struct btree_root *root, struct btree_iter *iter);
+extern int btree_seek(const struct btree_root *root, uint64_t key, struct btree_iter *iter);
+extern int btree_next(struct btree_iter *iter);
+extern int btree_prev(struct btree_iter *iter);
+
+/*!
+ * \brief Iterate all keys in [lo, hi] in order.
+ */
+#define btree_for_each_range(_root, _iter, _lo, _hi) \
+	for (btree_seek((_root), (_lo), (_iter)); \
+		btree_iter_valid(_iter) && btree_iter_key(_iter) <= (_hi); \
+		btree_next(_iter))
+
+#define btree_for_each(_root, _iter) \
+	for (btree_first((_root), (_iter)); btree_iter_valid(_iter); btree_next(_iter))
+
+#endif /* BTREE_H_ */
@@ -0,0 +1,143 @@
+/*
+ * btree vs rbtree benchmark.
+ *
+ * Usage: btree_bench [perf_loops [nodes]]
+ *
+ * The same workload as rbtree_test.c: insert NODES random keys, then erase them
+ * all, PERF_LOOPS times. Lookups of every key are timed in between, once in
+ * insertion order and once in random order. Insertion order favours rbtree,
+ * since neighbouring nodes[] are touched by consecutive lookups.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "rbtree/rbtree_map.h"
+#include "btree.h"
+
+#define NODES       100000
+#define PERF_LOOPS  1000
+
+struct test_node
+{
+	uint32_t key;
+	struct rb_node rb;
+};
+
+static struct test_node *nodes;
+static unsigned int *order; //!< Random permutation of nodes[] index
+static unsigned int nr_nodes = NODES;
+
+RB_DEFINE_MAP(rb_bench, struct test_node, rb, key, RB_MAP_CMP_NUM)
+
+int main(int argc, char **argv)
+{
+	struct rb_root rb_root = RB_ROOT;
+	struct btree_root bt_root = BTREE_ROOT;
+	unsigned int loops = PERF_LOOPS, i, j;
+	uint64_t t, ns_insert, ns_erase, ns_lookup, ns_lookup_rand;
+	unsigned long miss = 0;
+
+	loops = bench_arg(argc, argv, 1, PERF_LOOPS);
+	nr_nodes = bench_arg(argc, argv, 2, NODES);
+	if (loops == 0 || nr_nodes == 0)
+	{
+		return bench_usage(argv[0], "[perf_loops [nodes]]");
+	}
+
+	nodes = calloc(nr_nodes, sizeof(*nodes));
+	order = calloc(nr_nodes, sizeof(*order));
+	if (nodes == NULL || order == NULL)
+	{
+		return 1;
+	}
+
+	/* Unique keys in random order, so both trees hold the same set. */
+	for (j = 0; j < nr_nodes; j++)
+	{
+		nodes[j].key = j * 2654435761U;
+		order[j] = j;
+	}
+
+	for (j = nr_nodes - 1; j > 0; j--)
+	{
+		unsigned int k = random() % (j + 1), tmp = order[j];
+
+		order[j] = order[k];
+		order[k] = tmp;
+	}
+
+	printf("tree,op,nodes,loops,ns_per_op\n");
+
+	ns_insert = ns_erase = ns_lookup = ns_lookup_rand = 0;
+	for (i = 0; i < loops; i++)
+	{
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			rb_bench_insert(&rb_root, nodes + j);
+		ns_insert += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			miss += (rb_bench_find(&rb_root, nodes[j].key) == NULL);
+		ns_lookup += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			miss += (rb_bench_find(&rb_root, nodes[order[j]].key) == NULL);
+		ns_lookup_rand += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			rb_erase(&nodes[j].rb, &rb_root);
+		ns_erase += bench_now_ns() - t;
+	}
+
+	bench_print_result("rbtree", "insert", ns_insert, nr_nodes, loops);
+	bench_print_result("rbtree", "lookup", ns_lookup, nr_nodes, loops);
+	bench_print_result("rbtree", "lookup_rand", ns_lookup_rand, nr_nodes, loops);
+	bench_print_result("rbtree", "erase", ns_erase, nr_nodes, loops);
+
+	ns_insert = ns_erase = ns_lookup = ns_lookup_rand = 0;
+	for (i = 0; i < loops; i++)
+	{
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			btree_insert(&bt_root, nodes[j].key, nodes + j);
+		ns_insert += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			miss += (btree_lookup(&bt_root, nodes[j].key) == NULL);
+		ns_lookup += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			miss += (btree_lookup(&bt_root, nodes[order[j]].key) == NULL);
+		ns_lookup_rand += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			btree_erase(&bt_root, nodes[j].key);
+		ns_erase += bench_now_ns() - t;
+	}
+
+	bench_print_result("btree", "insert", ns_insert, nr_nodes, loops);
+	bench_print_result("btree", "lookup", ns_lookup, nr_nodes, loops);
+	bench_print_result("btree", "lookup_rand", ns_lookup_rand, nr_nodes, loops);
+	bench_print_result("btree", "erase", ns_erase, nr_nodes, loops);
+
+	btree_destroy(&bt_root);
+	free(order);
+	free(nodes);
+
+	if (miss)
+	{
+		fprintf(stderr, "BUG: %lu lookups missed\n", miss);
+		return 1;
+	}
+
+	return 0;
+}
@@ -1,10 +1,16 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "fifobuf.h"
+#include "atomic/atomic.h"
 
 #define HAVE_DEBUG_MSG (0) //!< Say 1 to debug
 
@@ -61,6 +67,9 @@ typedef struct fifobuf_data
 	uint8_t *current; //!< Current data position to append. (Tricky)
 	fbd_free_t free_func; //!<Use this function to free memory
 
+	atomic_t ref; //!< Users of data[]: the data itself and its views.
+	struct fifobuf_data *owner; //!< Not NULL if this is a read-only view of owner's data[].
+
 	uint8_t data[0];
 } fifobuf_data_t;
 
@@ -95,6 +104,8 @@ typedef struct fifobuf_tail
 		(_fbd)->data_free = _max_data_size; \
 		(_fbd)->free_func = (fbd_free_t) _free_func; \
 		(_fbd)->current = (_fbd)->data; \
+		atomic_set(&((_fbd)->ref), 1); \
+		(_fbd)->owner = NULL; \
 	} while (0)
 
 #define fifobuf_data_tail(_fbd) \
@@ -106,15 +117,20 @@ typedef struct fifobuf_tail
 		fifobuf_data_init(_fbd, (_fbd)->data_size, (_fbd)->free_func); \
 	} while (0)
 
-static void fifobuf_data_free(fifobuf_data_t *fbdata)
+/*
+ * Drop one ref of data[]. Free memory at the last one.
+ */
+static void fifobuf_data_put(fifobuf_data_t *fbdata)
 {
-	DBG("Free a data %p\n", fbdata);
-
-#if 1 /* Optimize */
-	list_del(&(fbdata->list));
-#else
-	fifobuf_data_exit(fbdata);
-#endif
+	/*
+	 * ref 1 means no view exists, and nobody else can create one. The load is
+	 * acquire: the last view may have been put by another thread, whose uses
+	 * of the block must be visible before it is freed or reused here.
+	 */
+	if (atomic_read_acquire(&(fbdata->ref)) != 1 && !atomic_dec_and_test(&(fbdata->ref)))
+	{
+		return;
+	}
 
 #if HAVE_FIFOBUF_TAIL
 	{ // Detect overflow bug.
@@ -129,6 +145,148 @@ static void fifobuf_data_free(fifobuf_data_t *fbdata)
 	fbdata->free_func(fbdata);
 }
 
+static void fifobuf_data_free(fifobuf_data_t *fbdata)
+{
+	fifobuf_data_t *owner;
+
+	DBG("Free a data %p\n", fbdata);
+
+#if 1 /* Optimize */
+	list_del(&(fbdata->list));
+#else
+	fifobuf_data_exit(fbdata);
+#endif
+
+	if (fbdata->owner)
+	{
+		owner = fbdata->owner;
+		fbdata->free_func(fbdata);
+		fbdata = owner;
+	}
+
+	fifobuf_data_put(fbdata);
+}
+
+/*
+ * Alloc a read-only view of len bytes at ptr in fbdata. Always refer to the real owner.
+ */
+static fifobuf_data_t *fifobuf_data_view_alloc(fifobuf_data_t *fbdata, uint8_t *ptr, const unsigned int len)
+{
+	fifobuf_data_t *view, *owner = (fbdata->owner) ? fbdata->owner : fbdata;
+
+	view = MY_KMALLOC_SLEEP(sizeof(*view));
+	if (view == NULL)
+	{
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&(view->list));
+	view->data_size = 0;
+	view->data_used = len;
+	view->data_free = 0;
+	view->current = ptr;
+	view->free_func = (fbd_free_t) MY_KFREE;
+	atomic_set(&(view->ref), 1);
+	view->owner = owner;
+
+	(void) atomic_add_return_relaxed(1, &(owner->ref));
+
+	return view;
+}
+
+/*
+ * Process-wide sum of (data_used + data_free) of all fifobufs.
+ */
+static atomic64_t fifobuf_mem_total = ATOMIC64_INIT(0);
+static unsigned long fifobuf_mem_budget = 0; //!< 0: unlimited
+
+#define fifobuf_mem_add(_n) (void) atomic64_add_return_relaxed((int64_t) (_n), &fifobuf_mem_total)
+#define fifobuf_mem_sub(_n) (void) atomic64_sub_return_relaxed((int64_t) (_n), &fifobuf_mem_total)
+
+/*!
+ * \brief Get the sum of (data_used + data_free) of all fifobufs in this process.
+ */
+unsigned long fifobuf_mem_get(void)
+{
+	return (unsigned long) atomic64_read(&fifobuf_mem_total);
+}
+
+/*!
+ * \brief Set a process-wide memory budget (bytes) of all fifobufs.
+ *
+ * \param budget max fifobuf_mem_get(). 0: unlimited.
+ *
+ * \note fifobuf_extend_*() fails (so does enqueue) if a new data block exceeds the budget.
+ * Fifobufs which already hold memory are not shrunk.
+ */
+void fifobuf_mem_set_budget(unsigned long budget)
+{
+	WRITE_ONCE(fifobuf_mem_budget, budget);
+}
+
+static inline int fifobuf_mem_over_budget(const unsigned int add_len)
+{
+	unsigned long budget = READ_ONCE(fifobuf_mem_budget);
+
+	return (budget && fifobuf_mem_get() + add_len > budget);
+}
+
+/*!
+ * \brief Bound a fifobuf by watermarks.
+ *
+ * \param fb   fifobuf ctx
+ * \param high enqueue returns FIFOBUF_BACKPRESSURE once data_used reaches high,
+ *             and FIFOBUF_FULL after that. 0: unbounded.
+ * \param low  enqueue is accepted again after data_used drops to low. (< high)
+ *
+ * \note data_used may exceed high by the length of the last accepted enqueue.
+ */
+void fifobuf_set_watermark(fifobuf_t *fb, unsigned int high, unsigned int low)
+{
+	if (low >= high)
+	{
+		low = (high) ? high - 1 : 0;
+	}
+
+	fb->wm_high = high;
+	fb->wm_low = low;
+	fb->wm_full = (high && fb->data_used >= high);
+}
+
+/*
+ * Update watermark state after data_used changes.
+ */
+static inline int fifobuf_wm_update(fifobuf_t *fb)
+{
+	if (fb->wm_high == 0)
+	{
+		return 0;
+	}
+
+	if (fb->data_used >= fb->wm_high)
+	{
+		fb->wm_full = 1;
+		return FIFOBUF_BACKPRESSURE;
+	}
+
+	if (fb->data_used <= fb->wm_low)
+	{
+		fb->wm_full = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Free a data which is linked in fifobuf and drop its free space from fifobuf.
+ */
+static inline void fifobuf_data_release(fifobuf_t *fb, fifobuf_data_t *fbdata)
+{
+	fb->data_free -= fbdata->data_free;
+	fifobuf_mem_sub(fbdata->data_free);
+	fifobuf_data_free(fbdata);
+}
+
 #define __calc_data_size(_alloc_len) ((_alloc_len) - sizeof(fifobuf_data_t) - fifobuf_tail_size)
 
 typedef void *(* fifobuf_data_alloc_func_t)(const unsigned int alloc_len);
@@ -169,127 +327,582 @@ static inline fifobuf_data_t *__fifobuf_data_alloc(const fifobuf_data_alloc_func
 	return fbdata;
 }
 
-static void *fifobuf_kmalloc_atomic(const unsigned int alloc_len)
+/*
+ * Per-thread data block cache.
+ *
+ * Emptied data blocks of the atomic/sleep allocators go back to a small cache of
+ * the freeing thread instead of free(3). The cache is shared by all fifobufs of
+ * the thread, and keeps at most fifobuf_cache_limit blocks per size class.
+ * Blocks move between threads freely: whoever frees a block caches it. Nothing
+ * returns them to the allocating thread, see fifobuf.h.
+ */
+#define FIFOBUF_CACHE_CLASS_MAX (4) //!< Different alloc len to cache per thread.
+
+struct fifobuf_cache_class
+{
+	unsigned int alloc_len; //!< 0: unused class
+	unsigned int nr;
+	struct list_head list; //!< Cached data blocks. Store cache-maybe-hot at head.
+};
+
+struct fifobuf_cache
+{
+	struct fifobuf_cache_class cls[FIFOBUF_CACHE_CLASS_MAX];
+};
+
+static unsigned int fifobuf_cache_limit = FIFOBUF_CACHE_LIMIT_DFL;
+
+static __thread struct fifobuf_cache *fifobuf_cache_tls = NULL;
+static __thread int fifobuf_cache_dead = 0; //!< The thread is exiting: bypass the cache.
+
+static pthread_key_t fifobuf_cache_key;
+static pthread_once_t fifobuf_cache_once = PTHREAD_ONCE_INIT;
+
+static void fifobuf_cache_destroy(void *p)
 {
-	return MY_KMALLOC_ATOMIC(alloc_len);
+	struct fifobuf_cache *cache = (struct fifobuf_cache *) p;
+	fifobuf_data_t *fbdata, *fbdata_save;
+	unsigned int i;
+
+	/*
+	 * Other key destructors may still alloc or free blocks on this thread.
+	 * Send them to malloc/free, not to the cache freed below.
+	 */
+	fifobuf_cache_tls = NULL;
+	fifobuf_cache_dead = 1;
+
+	for (i = 0; i < FIFOBUF_CACHE_CLASS_MAX; i++)
+	{
+		list_for_each_entry_safe(fbdata, fbdata_save, &(cache->cls[i].list), list)
+		{
+			list_del(&(fbdata->list));
+			MY_KFREE(fbdata);
+		}
+	}
+
+	MY_KFREE(cache);
 }
 
-static fifobuf_data_t *fifobuf_data_alloc_atomic(unsigned int alloc_len /* include struct header */)
+static void fifobuf_cache_key_init(void)
 {
-	return __fifobuf_data_alloc(fifobuf_kmalloc_atomic, (void *) MY_KFREE, alloc_len);
+	/* Release the cache of an exiting thread. */
+	(void) pthread_key_create(&fifobuf_cache_key, fifobuf_cache_destroy);
 }
 
-static void *fifobuf_kmalloc_sleep(const unsigned int alloc_len)
+static struct fifobuf_cache *fifobuf_cache_get(void)
 {
-	return MY_KMALLOC_SLEEP(alloc_len);
+	struct fifobuf_cache *cache = fifobuf_cache_tls;
+	unsigned int i;
+
+	if (cache || fifobuf_cache_dead)
+	{
+		return cache;
+	}
+
+	cache = MY_KMALLOC_SLEEP(sizeof(*cache));
+	if (cache == NULL)
+	{
+		return NULL;
+	}
+
+	for (i = 0; i < FIFOBUF_CACHE_CLASS_MAX; i++)
+	{
+		cache->cls[i].alloc_len = 0;
+		cache->cls[i].nr = 0;
+		INIT_LIST_HEAD(&(cache->cls[i].list));
+	}
+
+	pthread_once(&fifobuf_cache_once, fifobuf_cache_key_init);
+	(void) pthread_setspecific(fifobuf_cache_key, cache);
+
+	fifobuf_cache_tls = cache;
+	return cache;
 }
 
-static fifobuf_data_t *fifobuf_data_alloc_sleep(unsigned int alloc_len /* include struct header */)
+static struct fifobuf_cache_class *fifobuf_cache_find(struct fifobuf_cache *cache, const unsigned int alloc_len)
 {
-	return __fifobuf_data_alloc(fifobuf_kmalloc_sleep, (void *) MY_KFREE, alloc_len);
+	unsigned int i;
+
+	for (i = 0; i < FIFOBUF_CACHE_CLASS_MAX; i++)
+	{
+		if (cache->cls[i].alloc_len == alloc_len)
+		{
+			return &(cache->cls[i]);
+		}
+
+		if (cache->cls[i].alloc_len == 0)
+		{
+			/* Claim a new class. */
+			cache->cls[i].alloc_len = alloc_len;
+			return &(cache->cls[i]);
+		}
+	}
+
+	return NULL;
 }
 
-static void *fifobuf_vmalloc(const unsigned int alloc_len)
+static void *fifobuf_cache_alloc(const unsigned int alloc_len, void *(* alloc_func)(size_t))
 {
-	return MY_VMALLOC(alloc_len);
+	struct fifobuf_cache *cache;
+	struct fifobuf_cache_class *cls;
+	fifobuf_data_t *fbdata;
+
+	if (fifobuf_cache_limit)
+	{
+		cache = fifobuf_cache_get();
+		if (cache)
+		{
+			cls = fifobuf_cache_find(cache, alloc_len);
+			if (cls && cls->nr)
+			{
+				fbdata = list_first_entry(&(cls->list), fifobuf_data_t, list);
+				list_del(&(fbdata->list));
+				cls->nr--;
+
+				return fbdata;
+			}
+		}
+	}
+
+	return alloc_func(alloc_len);
 }
 
-static fifobuf_data_t *fifobuf_data_alloc_vm(unsigned int alloc_len /* include struct header */)
+/*
+ * free_func of cached data blocks. The block is already unlinked from fifobuf.
+ */
+static void fifobuf_cache_free(void *p)
 {
-	return __fifobuf_data_alloc(fifobuf_vmalloc, (void *) MY_VFREE, alloc_len);
+	fifobuf_data_t *fbdata = (fifobuf_data_t *) p;
+	const unsigned int alloc_len = fbdata->data_size + sizeof(fifobuf_data_t) + fifobuf_tail_size;
+	struct fifobuf_cache *cache;
+	struct fifobuf_cache_class *cls;
+
+	if (fifobuf_cache_limit)
+	{
+		cache = fifobuf_cache_get();
+		if (cache)
+		{
+			cls = fifobuf_cache_find(cache, alloc_len);
+			if (cls && cls->nr < fifobuf_cache_limit)
+			{
+				list_add(&(fbdata->list), &(cls->list));
+				cls->nr++;
+				return;
+			}
+		}
+	}
+
+	MY_KFREE(fbdata);
 }
 
-static void *fifobuf_kmalloc_atomic_notrace(const unsigned int alloc_len)
+/*!
+ * \brief Set max cached data blocks per size class per thread.
+ *
+ * \param limit 0: disable data block cache.
+ *
+ * \note Blocks already cached beyond the new limit are kept until fifobuf_cache_flush().
+ */
+void fifobuf_cache_set_limit(unsigned int limit)
 {
-	return MY_KMALLOC_ATOMIC_NOTRACE(alloc_len);
+	fifobuf_cache_limit = limit;
 }
 
-static fifobuf_data_t *fifobuf_data_alloc_atomic_notrace(unsigned int alloc_len /* include struct header */)
+/*!
+ * \brief Free all data blocks cached by the calling thread.
+ *
+ * \note A thread's cache is also freed automatically at thread exit.
+ */
+void fifobuf_cache_flush(void)
 {
-	return __fifobuf_data_alloc(fifobuf_kmalloc_atomic_notrace, (void *) MY_KFREE_NOTRACE, alloc_len);
+	struct fifobuf_cache *cache = fifobuf_cache_tls;
+	fifobuf_data_t *fbdata, *fbdata_save;
+	unsigned int i;
+
+	if (cache == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < FIFOBUF_CACHE_CLASS_MAX; i++)
+	{
+		list_for_each_entry_safe(fbdata, fbdata_save, &(cache->cls[i].list), list)
+		{
+			list_del(&(fbdata->list));
+			MY_KFREE(fbdata);
+		}
+
+		cache->cls[i].nr = 0;
+	}
 }
 
-static void *fifobuf_kmalloc_sleep_notrace(const unsigned int alloc_len)
+static void *fifobuf_kmalloc_atomic(const unsigned int alloc_len)
 {
-	return MY_KMALLOC_SLEEP_NOTRACE(alloc_len);
+	return fifobuf_cache_alloc(alloc_len, MY_KMALLOC_ATOMIC);
 }
 
-static fifobuf_data_t *fifobuf_data_alloc_sleep_notrace(unsigned int alloc_len /* include struct header */)
+static fifobuf_data_t *fifobuf_data_alloc_atomic(unsigned int alloc_len /* include struct header */)
 {
-	return __fifobuf_data_alloc(fifobuf_kmalloc_sleep_notrace, (void *) MY_KFREE_NOTRACE, alloc_len);
+	return __fifobuf_data_alloc(fifobuf_kmalloc_atomic, fifobuf_cache_free, alloc_len);
 }
 
-static void *fifobuf_vmalloc_notrace(const unsigned int alloc_len)
+static void *fifobuf_kmalloc_sleep(const unsigned int alloc_len)
 {
-	return MY_VMALLOC_NOTRACE(alloc_len);
+	return fifobuf_cache_alloc(alloc_len, MY_KMALLOC_SLEEP);
 }
 
-static fifobuf_data_t *fifobuf_data_alloc_vm_notrace(unsigned int alloc_len /* include struct header */)
+static fifobuf_data_t *fifobuf_data_alloc_sleep(unsigned int alloc_len /* include struct header */)
 {
-	return __fifobuf_data_alloc(fifobuf_vmalloc_notrace, (void *) MY_VFREE_NOTRACE, alloc_len);
+	return __fifobuf_data_alloc(fifobuf_kmalloc_sleep, fifobuf_cache_free, alloc_len);
 }
 
-static inline unsigned int fifobuf_data_enqueue(fifobuf_data_t *fbdata, void *data, unsigned int data_len)
+/*
+ * vm region: a process-wide pre-mapped region cut into equal slots for the vm allocators.
+ *
+ *   base                                                   base + size
+ *   +--------+--------+--------+--------+-- ... --+--------+
+ *   | slot 0 | slot 1 | slot 2 | slot 3 |         | slot n |
+ *   +--------+--------+--------+--------+-- ... --+--------+
+ *
+ * Pages are populated (and optionally locked) at setup, so the data path takes
+ * no page fault. Free slots are linked through their first bytes.
+ */
+#define FIFOBUF_VM_HUGEPAGE_SIZE (2UL * 1024 * 1024)
+#define FIFOBUF_VM_SLOT_ALIGN (64)
+
+static struct fifobuf_vm
 {
-	unsigned int consume;
+	pthread_mutex_t lock;
+	uint8_t *base; //!< NULL if vm region is not set up.
+	size_t size;
+	size_t map_size; //!< Includes alignment padding before base.
+	uint8_t *map_base;
+	unsigned int slot_size;
+	unsigned int flags;
+	unsigned int nr_slot;
+	unsigned int nr_free;
+	void *free_slot; //!< Singly linked free slots.
+} fifobuf_vm = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+#define fifobuf_vm_is_slot(_p) \
+	((uint8_t *) (_p) >= fifobuf_vm.base && (uint8_t *) (_p) < fifobuf_vm.base + fifobuf_vm.size)
 
-	if (data_len == 0)
+/*!
+ * \brief Set up the pre-mapped region of fifobuf_*_vm*().
+ *
+ * \param size      region size (bytes)
+ * \param data_size data block size of fifobufs using vm allocators. Larger blocks use malloc.
+ * \param flags     FIFOBUF_VM_HUGETLB | FIFOBUF_VM_THP | FIFOBUF_VM_MLOCK
+ *
+ * \return 0 if ok
+ * \return -1 if error, or vm region is already set up. errno is set.
+ *
+ * \note Without a vm region, or after it runs out of slots, vm allocators fall back to malloc.
+ * If FIFOBUF_VM_HUGETLB fails (no hugepage reserved), THP is tried instead.
+ *
+ * \sa fifobuf_vm_cleanup
+ */
+int fifobuf_vm_setup(size_t size, unsigned int data_size, unsigned int flags)
+{
+	const int prot = PROT_READ | PROT_WRITE;
+	const int map_flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+	unsigned int slot_size, i;
+	uint8_t *map_base = MAP_FAILED, *base;
+	size_t map_size;
+	int err;
+
+	slot_size = data_size + sizeof(fifobuf_data_t) + fifobuf_tail_size;
+	slot_size = (slot_size + FIFOBUF_VM_SLOT_ALIGN - 1) & ~(FIFOBUF_VM_SLOT_ALIGN - 1);
+
+	size = (size + FIFOBUF_VM_HUGEPAGE_SIZE - 1) & ~(FIFOBUF_VM_HUGEPAGE_SIZE - 1);
+	if (size == 0 || size / slot_size == 0)
 	{
-		return 0;
+		errno = EINVAL;
+		return -1;
 	}
 
-	if (fbdata->data_free >= data_len)
+	pthread_mutex_lock(&fifobuf_vm.lock);
+
+	if (fifobuf_vm.base)
 	{
-		/*
-		 * Consume all input data
-		 */
-		memcpy(fbdata->current + fbdata->data_used, data, data_len);
-		consume = data_len;
+		pthread_mutex_unlock(&fifobuf_vm.lock);
+		errno = EBUSY;
+		return -1;
+	}
 
-		fbdata->data_used += data_len;
-		fbdata->data_free -= data_len;
+	if (flags & FIFOBUF_VM_HUGETLB)
+	{
+		map_size = size;
+		map_base = mmap(NULL, map_size, prot, map_flags | MAP_HUGETLB, -1, 0);
+		if (map_base == MAP_FAILED)
+		{
+			DBG("Cannot map hugetlb pages. Try THP\n");
+			flags = (flags & ~FIFOBUF_VM_HUGETLB) | FIFOBUF_VM_THP;
+		}
 	}
-	else if (fbdata->data_free > 0)
+
+	if (map_base == MAP_FAILED)
 	{
-		memcpy(fbdata->current + fbdata->data_used, data, fbdata->data_free);
-		consume = fbdata->data_free;
+		/* Map one more hugepage to align base. THP only backs aligned 2MB ranges. */
+		map_size = size + FIFOBUF_VM_HUGEPAGE_SIZE;
+		map_base = mmap(NULL, map_size, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (map_base == MAP_FAILED)
+		{
+			pthread_mutex_unlock(&fifobuf_vm.lock);
+			return -1;
+		}
 
-		fbdata->data_used += fbdata->data_free;
-		fbdata->data_free -= fbdata->data_free;
+		base = (uint8_t *) (((uintptr_t) map_base + FIFOBUF_VM_HUGEPAGE_SIZE - 1) & ~(FIFOBUF_VM_HUGEPAGE_SIZE - 1));
+
+#ifdef MADV_HUGEPAGE
+		if (flags & FIFOBUF_VM_THP)
+		{
+			madvise(base, size, MADV_HUGEPAGE);
+		}
+#endif
+
+		/* Populate after madvise, so that faults get hugepages. */
+		for (i = 0; i < size / FIFOBUF_VM_HUGEPAGE_SIZE; i++)
+		{
+			memset(base + i * FIFOBUF_VM_HUGEPAGE_SIZE, 0x00, FIFOBUF_VM_HUGEPAGE_SIZE);
+		}
 	}
 	else
 	{
-		consume = 0;
+		base = map_base;
 	}
 
-	return consume;
-}
-
-static inline unsigned int fifobuf_data_dequeue(fifobuf_data_t *fbdata, uint8_t *data, unsigned int data_len)
-{
-	unsigned int consume = 0;
-
-	if (fbdata->data_used >= data_len)
+	if ((flags & FIFOBUF_VM_MLOCK) && mlock(base, size) < 0)
 	{
-		memcpy(data, fbdata->current, data_len);
-		consume += data_len;
-
-		fbdata->current += data_len;
-		fbdata->data_used -= data_len;
+		err = errno;
+		ERR("Cannot mlock %zu bytes (errno %d)\n", size, err);
+		munmap(map_base, map_size);
+		pthread_mutex_unlock(&fifobuf_vm.lock);
+		errno = err;
+		return -1;
 	}
-	else
+
+	fifobuf_vm.map_base = map_base;
+	fifobuf_vm.map_size = map_size;
+	fifobuf_vm.base = base;
+	fifobuf_vm.size = size;
+	fifobuf_vm.slot_size = slot_size;
+	fifobuf_vm.flags = flags;
+	fifobuf_vm.nr_slot = size / slot_size;
+	fifobuf_vm.nr_free = fifobuf_vm.nr_slot;
+
+	/* Link free slots in address order. */
+	fifobuf_vm.free_slot = NULL;
+	for (i = fifobuf_vm.nr_slot; i > 0; i--)
 	{
-		memcpy(data, fbdata->current, fbdata->data_used);
-		consume += fbdata->data_used;
+		void **slot = (void **) (base + (size_t) (i - 1) * slot_size);
 
-		fbdata->current += fbdata->data_used;
-		fbdata->data_used -= fbdata->data_used;
+		*slot = fifobuf_vm.free_slot;
+		fifobuf_vm.free_slot = slot;
 	}
 
-	return consume;
+	pthread_mutex_unlock(&fifobuf_vm.lock);
+	return 0;
 }
 
-static inline int fifobuf_data_is_empty(fifobuf_data_t *fbdata)
+/*!
+ * \brief Unmap the region of fifobuf_vm_setup().
+ *
+ * \return 0 if ok
+ * \return -1 if some slots are still used by fifobufs. (errno EBUSY)
+ */
+int fifobuf_vm_cleanup(void)
+{
+	pthread_mutex_lock(&fifobuf_vm.lock);
+
+	if (fifobuf_vm.base == NULL)
+	{
+		pthread_mutex_unlock(&fifobuf_vm.lock);
+		return 0;
+	}
+
+	if (fifobuf_vm.nr_free != fifobuf_vm.nr_slot)
+	{
+		pthread_mutex_unlock(&fifobuf_vm.lock);
+		errno = EBUSY;
+		return -1;
+	}
+
+	munmap(fifobuf_vm.map_base, fifobuf_vm.map_size);
+
+	fifobuf_vm.base = NULL;
+	fifobuf_vm.size = 0;
+	fifobuf_vm.free_slot = NULL;
+	fifobuf_vm.nr_slot = 0;
+	fifobuf_vm.nr_free = 0;
+
+	pthread_mutex_unlock(&fifobuf_vm.lock);
+	return 0;
+}
+
+/*
+ * Get a slot of vm region. NULL if alloc_len does not fit or no slot is left.
+ */
+static void *fifobuf_vm_slot_alloc(const unsigned int alloc_len)
+{
+	void **slot = NULL;
+
+	if (fifobuf_vm.base == NULL || alloc_len > fifobuf_vm.slot_size)
+	{
+		return NULL;
+	}
+
+	pthread_mutex_lock(&fifobuf_vm.lock);
+
+	if (fifobuf_vm.base && fifobuf_vm.free_slot)
+	{
+		slot = (void **) fifobuf_vm.free_slot;
+		fifobuf_vm.free_slot = *slot;
+		fifobuf_vm.nr_free--;
+	}
+
+	pthread_mutex_unlock(&fifobuf_vm.lock);
+
+	return slot;
+}
+
+static void fifobuf_vm_slot_free(void *p)
+{
+	pthread_mutex_lock(&fifobuf_vm.lock);
+
+	*((void **) p) = fifobuf_vm.free_slot;
+	fifobuf_vm.free_slot = p;
+	fifobuf_vm.nr_free++;
+
+	pthread_mutex_unlock(&fifobuf_vm.lock);
+}
+
+static void *fifobuf_vmalloc(const unsigned int alloc_len)
+{
+	void *p = fifobuf_vm_slot_alloc(alloc_len);
+
+	return (p) ? p : MY_VMALLOC(alloc_len);
+}
+
+static void fifobuf_vfree(void *p)
+{
+	if (fifobuf_vm_is_slot(p))
+	{
+		fifobuf_vm_slot_free(p);
+		return;
+	}
+
+	MY_VFREE(p);
+}
+
+static fifobuf_data_t *fifobuf_data_alloc_vm(unsigned int alloc_len /* include struct header */)
+{
+	return __fifobuf_data_alloc(fifobuf_vmalloc, fifobuf_vfree, alloc_len);
+}
+
+static void *fifobuf_kmalloc_atomic_notrace(const unsigned int alloc_len)
+{
+	return MY_KMALLOC_ATOMIC_NOTRACE(alloc_len);
+}
+
+static fifobuf_data_t *fifobuf_data_alloc_atomic_notrace(unsigned int alloc_len /* include struct header */)
+{
+	return __fifobuf_data_alloc(fifobuf_kmalloc_atomic_notrace, (void *) MY_KFREE_NOTRACE, alloc_len);
+}
+
+static void *fifobuf_kmalloc_sleep_notrace(const unsigned int alloc_len)
+{
+	return MY_KMALLOC_SLEEP_NOTRACE(alloc_len);
+}
+
+static fifobuf_data_t *fifobuf_data_alloc_sleep_notrace(unsigned int alloc_len /* include struct header */)
+{
+	return __fifobuf_data_alloc(fifobuf_kmalloc_sleep_notrace, (void *) MY_KFREE_NOTRACE, alloc_len);
+}
+
+static void *fifobuf_vmalloc_notrace(const unsigned int alloc_len)
+{
+	void *p = fifobuf_vm_slot_alloc(alloc_len);
+
+	return (p) ? p : MY_VMALLOC_NOTRACE(alloc_len);
+}
+
+static void fifobuf_vfree_notrace(void *p)
+{
+	if (fifobuf_vm_is_slot(p))
+	{
+		fifobuf_vm_slot_free(p);
+		return;
+	}
+
+	MY_VFREE_NOTRACE(p);
+}
+
+static fifobuf_data_t *fifobuf_data_alloc_vm_notrace(unsigned int alloc_len /* include struct header */)
+{
+	return __fifobuf_data_alloc(fifobuf_vmalloc_notrace, fifobuf_vfree_notrace, alloc_len);
+}
+
+static inline unsigned int fifobuf_data_enqueue(fifobuf_data_t *fbdata, void *data, unsigned int data_len)
+{
+	unsigned int consume;
+
+	if (data_len == 0)
+	{
+		return 0;
+	}
+
+	if (fbdata->data_free >= data_len)
+	{
+		/*
+		 * Consume all input data
+		 */
+		memcpy(fbdata->current + fbdata->data_used, data, data_len);
+		consume = data_len;
+
+		fbdata->data_used += data_len;
+		fbdata->data_free -= data_len;
+	}
+	else if (fbdata->data_free > 0)
+	{
+		memcpy(fbdata->current + fbdata->data_used, data, fbdata->data_free);
+		consume = fbdata->data_free;
+
+		fbdata->data_used += fbdata->data_free;
+		fbdata->data_free -= fbdata->data_free;
+	}
+	else
+	{
+		consume = 0;
+	}
+
+	return consume;
+}
+
+static inline unsigned int fifobuf_data_dequeue(fifobuf_data_t *fbdata, uint8_t *data, unsigned int data_len)
+{
+	unsigned int consume = 0;
+
+	if (fbdata->data_used >= data_len)
+	{
+		memcpy(data, fbdata->current, data_len);
+		consume += data_len;
+
+		fbdata->current += data_len;
+		fbdata->data_used -= data_len;
+	}
+	else
+	{
+		memcpy(data, fbdata->current, fbdata->data_used);
+		consume += fbdata->data_used;
+
+		fbdata->current += fbdata->data_used;
+		fbdata->data_used -= fbdata->data_used;
+	}
+
+	return consume;
+}
+
+static inline int fifobuf_data_is_empty(fifobuf_data_t *fbdata)
 {
 	return (fbdata->data_used == 0);
 }
@@ -369,6 +982,12 @@ static inline int fifobuf_extend(fifobuf_t *fb, unsigned int add_len,
 
 	while (add_len)
 	{
+		if (fifobuf_mem_over_budget(fb->data_size))
+		{
+			DBG("Over memory budget\n");
+			return -1;
+		}
+
 		fbdata = alloc_func(fb->data_size);
 		if (fbdata == NULL)
 		{
@@ -381,6 +1000,7 @@ static inline int fifobuf_extend(fifobuf_t *fb, unsigned int add_len,
 
 		/* Calc free size */
 		fb->data_free += fbdata->data_free;
+		fifobuf_mem_add(fbdata->data_free);
 
 		if (add_len > fbdata->data_free)
 		{
@@ -428,6 +1048,12 @@ int fifobuf_extend_vm_notrace(fifobuf_t *fb, unsigned int add_len)
 
 static inline int fifobuf_enqueue(fifobuf_t *fb, void *data, unsigned int data_len, fifobuf_data_t * (* fifobuf_data_alloc_func)(unsigned int size))
 {
+	if (fb->wm_full)
+	{
+		DBG("Fifobuf %p is full (used=%u)\n", fb, fb->data_used);
+		return FIFOBUF_FULL;
+	}
+
 	if (fb->data_free < data_len)
 	{
 		/* Resource not enough. Alloc more data (* NOTE: extend first to make sure we can enqueue.) */
@@ -440,7 +1066,9 @@ static inline int fifobuf_enqueue(fifobuf_t *fb, void *data, unsigned int data_l
 
 	DBG("Try to enqueue %u bytes to %p (free=%u/%u)\n",
 		data_len, fb, fb->data_free, (fb->data_used + fb->data_free));
-	return __fifobuf_enqueue(fb, data, data_len);
+	__fifobuf_enqueue(fb, data, data_len);
+
+	return fifobuf_wm_update(fb);
 }
 
 int fifobuf_enqueue_atomic(fifobuf_t *fb, void *data, unsigned int data_len)
@@ -503,6 +1131,7 @@ int fifobuf_enqueue_zero_padding(fifobuf_t *fb)
 		break;
 	}
 
+	fifobuf_wm_update(fb);
 	return 0;
 }
 
@@ -560,7 +1189,7 @@ unsigned int fifobuf_dequeue(fifobuf_t *fb, uint8_t *buf, unsigned int buf_len)
 		if (fifobuf_data_is_empty(fbdata))
 		{
 #if (1) /* Free ASAP. */
-			fifobuf_data_free(fbdata);
+			fifobuf_data_release(fb, fbdata);
 #else   /* Free later */
 			/* Send back to free list. */
 			fifobuf_data_exit(fbdata);
@@ -569,6 +1198,9 @@ unsigned int fifobuf_dequeue(fifobuf_t *fb, uint8_t *buf, unsigned int buf_len)
 		}
 	} // end for
 
+	fifobuf_mem_sub(consume_total);
+	fifobuf_wm_update(fb);
+
 	DBG("Dequeue %u bytes from %p\n", consume_total, fb);
 	return consume_total;
 }
@@ -588,8 +1220,494 @@ void fifobuf_flush(fifobuf_t *fb)
 		fifobuf_data_free(fbdata);
 	}
 
+	fifobuf_mem_sub(fb->data_used + fb->data_free);
+
 	fb->data_free = 0;
 	fb->data_used = 0;
+	fb->wm_full = 0;
+}
+
+/*
+ * Drop len bytes from fifobuf head. Free emptied data ASAP.
+ */
+static unsigned int __fifobuf_consume(fifobuf_t *fb, unsigned int len)
+{
+	fifobuf_data_t *fbdata, *fbdata_save;
+	unsigned int consume, consume_total = 0;
+
+	list_for_each_entry_safe(fbdata, fbdata_save, &(fb->list_data_fifo), list)
+	{
+		if (len == 0)
+		{
+			break;
+		}
+
+		consume = (fbdata->data_used < len) ? fbdata->data_used : len;
+
+		fbdata->current += consume;
+		fbdata->data_used -= consume;
+
+		len -= consume;
+		fb->data_used -= consume;
+		consume_total += consume;
+
+		if (fifobuf_data_is_empty(fbdata))
+		{
+			fifobuf_data_release(fb, fbdata);
+		}
+	}
+
+	fifobuf_mem_sub(consume_total);
+	fifobuf_wm_update(fb);
+
+	return consume_total;
+}
+
+/*
+ * Account len bytes written in place after fifobuf tail.
+ * The same order as __fifobuf_enqueue: fifo tail first, then free list.
+ */
+static unsigned int __fifobuf_commit(fifobuf_t *fb, unsigned int len)
+{
+	fifobuf_data_t *fbdata, *fbdata_save;
+	unsigned int consume, consume_total = 0;
+
+	list_for_each_entry_reverse(fbdata, &(fb->list_data_fifo), list)
+	{
+		consume = (fbdata->data_free < len) ? fbdata->data_free : len;
+
+		fbdata->data_used += consume;
+		fbdata->data_free -= consume;
+
+		len -= consume;
+		fb->data_used += consume;
+		fb->data_free -= consume;
+		consume_total += consume;
+		break;
+	}
+
+	list_for_each_entry_safe(fbdata, fbdata_save, &(fb->list_data_free), list)
+	{
+		if (len == 0)
+		{
+			break;
+		}
+
+		consume = (fbdata->data_free < len) ? fbdata->data_free : len;
+
+		fbdata->data_used += consume;
+		fbdata->data_free -= consume;
+
+		list_move_tail(&(fbdata->list), &(fb->list_data_fifo));
+
+		len -= consume;
+		fb->data_used += consume;
+		fb->data_free -= consume;
+		consume_total += consume;
+	}
+
+	fifobuf_wm_update(fb);
+
+	return consume_total;
+}
+
+/*
+ * Drop free space of the fifo tail, so that new data blocks can be linked after it.
+ */
+static void fifobuf_seal_tail(fifobuf_t *fb)
+{
+	fifobuf_data_t *tail;
+
+	list_for_each_entry_reverse(tail, &(fb->list_data_fifo), list)
+	{
+		fb->data_free -= tail->data_free;
+		fifobuf_mem_sub(tail->data_free);
+		tail->data_free = 0;
+		break;
+	}
+}
+
+/*!
+ * \brief Get a contiguous space of at least len bytes after fifobuf tail to write in place.
+ *
+ * \param fb  fifobuf ctx
+ * \param len required bytes. Must <= data block size.
+ * \param ptr output pointer to the space
+ *
+ * \return Available contiguous bytes at ptr (>= len).
+ * \return -1 if there's no data block with enough free space. Call fifobuf_extend_*() and retry.
+ * \return FIFOBUF_FULL if fifobuf is above its watermark.
+ *
+ * \note If the tail data block is too small, the next free data block is used and
+ * the rest of the tail is sealed (no longer counted as free) at commit.
+ * Do not dequeue/consume between reserve and commit.
+ *
+ * \sa fifobuf_commit
+ */
+int fifobuf_reserve(fifobuf_t *fb, unsigned int len, void **ptr)
+{
+	fifobuf_data_t *fbdata;
+
+	if (fb->wm_full)
+	{
+		return FIFOBUF_FULL;
+	}
+
+	list_for_each_entry_reverse(fbdata, &(fb->list_data_fifo), list)
+	{
+		if (fbdata->data_free >= len)
+		{
+			goto found;
+		}
+		break;
+	}
+
+	list_for_each_entry(fbdata, &(fb->list_data_free), list)
+	{
+		if (fbdata->data_free >= len)
+		{
+			goto found;
+		}
+	}
+
+	return -1;
+
+found:
+	fb->reserve = fbdata;
+
+	*ptr = fbdata->current + fbdata->data_used;
+	return (int) fbdata->data_free;
+}
+
+/*!
+ * \brief Enqueue len bytes written in the space of the last fifobuf_reserve().
+ *
+ * \sa fifobuf_reserve
+ */
+void fifobuf_commit(fifobuf_t *fb, unsigned int len)
+{
+	fifobuf_data_t *fbdata = (fifobuf_data_t *) fb->reserve;
+
+	assert(fbdata != NULL);
+	assert(fbdata->data_free >= len);
+
+	fb->reserve = NULL;
+
+	if (len == 0)
+	{
+		return;
+	}
+
+	if (list_empty(&(fb->list_data_fifo)) || fb->list_data_fifo.prev != &(fbdata->list))
+	{
+		fifobuf_seal_tail(fb);
+		list_move_tail(&(fbdata->list), &(fb->list_data_fifo));
+	}
+
+	fbdata->data_used += len;
+	fbdata->data_free -= len;
+
+	fb->data_used += len;
+	fb->data_free -= len;
+
+	fifobuf_wm_update(fb);
+}
+
+/*!
+ * \brief Read the data at fifobuf head in place.
+ *
+ * \param fb  fifobuf ctx
+ * \param ptr output pointer to the data
+ * \param len output data len (bytes) of the first data block
+ *
+ * \return 0 if ok
+ * \return -1 if fifobuf is empty
+ *
+ * \sa fifobuf_consume
+ */
+int fifobuf_peek(fifobuf_t *fb, void **ptr, unsigned int *len)
+{
+	fifobuf_data_t *fbdata;
+
+	list_for_each_entry(fbdata, &(fb->list_data_fifo), list)
+	{
+		if (fbdata->data_used)
+		{
+			*ptr = fbdata->current;
+			*len = fbdata->data_used;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/*!
+ * \brief Drop len bytes from fifobuf head. (e.g. after fifobuf_peek)
+ *
+ * \return Number of bytes dropped.
+ */
+unsigned int fifobuf_consume(fifobuf_t *fb, unsigned int len)
+{
+	return __fifobuf_consume(fb, len);
+}
+
+/*!
+ * \brief Append all data of src to dst without copying data. src is unchanged.
+ *
+ * \param dst fifobuf to append
+ * \param src fifobuf to share
+ *
+ * \return 0 if ok
+ * \return -1 if cannot alloc memory. dst is unchanged.
+ *
+ * \note Data blocks are shared read-only and refcounted. Shared memory is freed
+ * after both fifobufs dequeue it. Cost is O(data blocks).
+ * \note After the clone, dst and src may each be dequeued and freed on its own
+ * thread, e.g. to fan one input out to workers. Only the shared refcount is
+ * touched by both. Whichever thread drops the last ref frees the block, into
+ * its own cache (see fifobuf_cache_set_limit()).
+ */
+int fifobuf_clone(fifobuf_t *dst, fifobuf_t *src)
+{
+	fifobuf_data_t *fbdata, *view, *view_save;
+	struct list_head list_view;
+	unsigned int data_used = 0;
+
+	INIT_LIST_HEAD(&list_view);
+
+	list_for_each_entry(fbdata, &(src->list_data_fifo), list)
+	{
+		if (fbdata->data_used == 0)
+		{
+			continue;
+		}
+
+		view = fifobuf_data_view_alloc(fbdata, fbdata->current, fbdata->data_used);
+		if (view == NULL)
+		{
+			list_for_each_entry_safe(view, view_save, &list_view, list)
+			{
+				fifobuf_data_free(view);
+			}
+			return -1;
+		}
+
+		list_add_tail(&(view->list), &list_view);
+		data_used += view->data_used;
+	}
+
+	if (data_used)
+	{
+		fifobuf_seal_tail(dst);
+		list_splice_init(&list_view, dst->list_data_fifo.prev); /* after the tail */
+		dst->data_used += data_used;
+
+		fifobuf_mem_add(data_used);
+		fifobuf_wm_update(dst);
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Move len bytes from src head to dst tail without copying data.
+ *
+ * \param dst fifobuf to append
+ * \param src fifobuf to dequeue
+ * \param len bytes to move
+ *
+ * \return Number of bytes moved. (<= len)
+ * \return -1 if cannot alloc memory. Nothing is moved.
+ *
+ * \note Whole data blocks are relinked. Only a data block split at len is
+ * shared by a refcounted view. Cost is O(data blocks).
+ */
+int fifobuf_splice(fifobuf_t *dst, fifobuf_t *src, unsigned int len)
+{
+	fifobuf_data_t *fbdata, *fbdata_save, *view = NULL;
+	unsigned int moved = 0, remain;
+
+	if (len > src->data_used)
+	{
+		len = src->data_used;
+	}
+
+	if (len == 0)
+	{
+		return 0;
+	}
+
+	/* Prepare the view of a split data block first, so that nothing can fail later. */
+	remain = len;
+	list_for_each_entry(fbdata, &(src->list_data_fifo), list)
+	{
+		if (fbdata->data_used > remain)
+		{
+			if (remain)
+			{
+				view = fifobuf_data_view_alloc(fbdata, fbdata->current, remain);
+				if (view == NULL)
+				{
+					return -1;
+				}
+			}
+			break;
+		}
+
+		remain -= fbdata->data_used;
+	}
+
+	fifobuf_seal_tail(dst);
+
+	list_for_each_entry_safe(fbdata, fbdata_save, &(src->list_data_fifo), list)
+	{
+		if (moved == len)
+		{
+			break;
+		}
+
+		if (fbdata->data_used > len - moved)
+		{
+			/* Split. dst gets the view, src skips the same bytes. */
+			list_add_tail(&(view->list), &(dst->list_data_fifo));
+
+			fbdata->current += view->data_used;
+			fbdata->data_used -= view->data_used;
+			moved += view->data_used;
+			break;
+		}
+
+		/* Relink the whole data block with its free space. */
+		list_move_tail(&(fbdata->list), &(dst->list_data_fifo));
+
+		src->data_free -= fbdata->data_free;
+		dst->data_free += fbdata->data_free;
+		moved += fbdata->data_used;
+	}
+
+	src->data_used -= moved;
+	dst->data_used += moved;
+
+	fifobuf_wm_update(src);
+	fifobuf_wm_update(dst);
+
+	return (int) moved;
+}
+
+#define FIFOBUF_IOV_MAX (64) //!< Max data blocks per writev/readv call.
+
+/*!
+ * \brief Write fifobuf data to fd by writev(2) without copying data in user space.
+ *
+ * \param fb fifobuf ctx
+ * \param fd file descriptor to write
+ *
+ * \return Return value of writev(2). Bytes accepted by kernel are dequeued.
+ */
+ssize_t fifobuf_writev(fifobuf_t *fb, int fd)
+{
+	struct iovec iov[FIFOBUF_IOV_MAX];
+	fifobuf_data_t *fbdata;
+	int iov_cnt = 0;
+	ssize_t ret;
+
+	if (fb->data_used == 0)
+	{
+		return 0;
+	}
+
+	list_for_each_entry(fbdata, &(fb->list_data_fifo), list)
+	{
+		if (iov_cnt >= FIFOBUF_IOV_MAX)
+		{
+			break;
+		}
+
+		if (fbdata->data_used == 0)
+		{
+			continue;
+		}
+
+		iov[iov_cnt].iov_base = fbdata->current;
+		iov[iov_cnt].iov_len = fbdata->data_used;
+		iov_cnt++;
+	}
+
+	ret = writev(fd, iov, iov_cnt);
+	if (ret > 0)
+	{
+		__fifobuf_consume(fb, (unsigned int) ret);
+	}
+
+	DBG("Writev %zd bytes from %p\n", ret, fb);
+	return ret;
+}
+
+/*!
+ * \brief Read from fd into fifobuf free space by readv(2) without copying data in user space.
+ *
+ * \param fb  fifobuf ctx
+ * \param fd  file descriptor to read
+ * \param len max bytes to read
+ *
+ * \return Return value of readv(2). Bytes read are enqueued.
+ * \return -1 with errno ENOBUFS if there's no free space, or fifobuf is above its watermark.
+ *
+ * \note Only existing free space is used. Call fifobuf_extend_*() first to reserve space.
+ */
+ssize_t fifobuf_readv(fifobuf_t *fb, int fd, unsigned int len)
+{
+	struct iovec iov[FIFOBUF_IOV_MAX];
+	fifobuf_data_t *fbdata;
+	unsigned int total = 0;
+	int iov_cnt = 0;
+	ssize_t ret;
+
+	if (len > fb->data_free)
+	{
+		len = fb->data_free;
+	}
+
+	if (len == 0 || fb->wm_full)
+	{
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	list_for_each_entry_reverse(fbdata, &(fb->list_data_fifo), list)
+	{
+		if (fbdata->data_free)
+		{
+			iov[iov_cnt].iov_base = fbdata->current + fbdata->data_used;
+			iov[iov_cnt].iov_len = (fbdata->data_free < len) ? fbdata->data_free : len;
+			total += iov[iov_cnt].iov_len;
+			iov_cnt++;
+		}
+		break;
+	}
+
+	list_for_each_entry(fbdata, &(fb->list_data_free), list)
+	{
+		if (total >= len || iov_cnt >= FIFOBUF_IOV_MAX)
+		{
+			break;
+		}
+
+		iov[iov_cnt].iov_base = fbdata->current + fbdata->data_used;
+		iov[iov_cnt].iov_len = (fbdata->data_free < len - total) ? fbdata->data_free : (len - total);
+		total += iov[iov_cnt].iov_len;
+		iov_cnt++;
+	}
+
+	ret = readv(fd, iov, iov_cnt);
+	if (ret > 0)
+	{
+		__fifobuf_commit(fb, (unsigned int) ret);
+	}
+
+	DBG("Readv %zd bytes to %p\n", ret, fb);
+	return ret;
 }
 
 /*!
@@ -640,6 +1758,8 @@ void fifobuf_exit(fifobuf_t *fb)
 		fifobuf_data_free(fbdata);
 	}
 
+	fifobuf_mem_sub(fb->data_used + fb->data_free);
+
 #if 0 // Optimize out.
 	fifobuf_init(fb);
 #endif
@@ -3,6 +3,9 @@
 #define FIFOBUF_H_
 
 #include <assert.h>
+#include <sys/types.h>
+
+#include "list/list.h"
 
 /*
  * fifobuf:
@@ -20,8 +23,18 @@ typedef struct fifobuf
 	unsigned int data_free;
 	struct list_head list_data_fifo; //!< To save allocated data list
 	struct list_head list_data_free; //!< To save temporarily free list
+	void *reserve; //!< Data block handed out by the last fifobuf_reserve()
+	unsigned int wm_high; //!< Stop enqueue at this data_used. 0: unbounded.
+	unsigned int wm_low; //!< Resume enqueue at this data_used.
+	unsigned int wm_full; //!< 1 after data_used reaches wm_high, until it drops to wm_low.
 } fifobuf_t;
 
+/*
+ * Enqueue results of a bounded fifobuf. (See fifobuf_set_watermark)
+ */
+#define FIFOBUF_BACKPRESSURE (1) //!< Data is enqueued, and fifobuf reaches high watermark. Stop producing.
+#define FIFOBUF_FULL (-2) //!< Fifobuf is still above low watermark. Nothing is enqueued.
+
 
 int fifobuf_extend_atomic(fifobuf_t *fb, unsigned int add_len);
 int fifobuf_extend_sleep(fifobuf_t *fb, unsigned int add_len);
@@ -50,10 +63,20 @@ unsigned int fifobuf_dequeue(fifobuf_t *fb, uint8_t *buf, unsigned int buf_len);
 		(_fb)->data_used = 0; \
 		(_fb)->data_free = 0; \
 		(_fb)->data_size = (_data_size); \
+		(_fb)->reserve = NULL; \
+		(_fb)->wm_high = 0; \
+		(_fb)->wm_low = 0; \
+		(_fb)->wm_full = 0; \
 		assert((_fb)->data_size >= 512); \
 	} while (0)
 
 #define fifobuf_get_data_used(_fb) ((_fb)->data_used)
+#define fifobuf_is_full(_fb) ((_fb)->wm_full)
+
+void fifobuf_set_watermark(fifobuf_t *fb, unsigned int high, unsigned int low);
+
+unsigned long fifobuf_mem_get(void);
+void fifobuf_mem_set_budget(unsigned long budget);
 
 void fifobuf_flush(fifobuf_t *fb);
 void fifobuf_exit(fifobuf_t *fb);
@@ -64,6 +87,41 @@ fifobuf_t *fifobuf_alloc_atomic(unsigned int data_size);
 
 unsigned int fifobuf_calibrate_data_size(const unsigned int minimal);
 
+/*
+ * Per-thread data block cache of the atomic/sleep allocators.
+ *
+ * A block goes to the cache of the thread which frees it, not of the thread
+ * which allocated it. When one thread enqueues and others dequeue (fifobuf_cc,
+ * or clones dequeued on other threads), blocks pile up in the consumer caches
+ * and the producer keeps calling malloc. A cache also holds at most
+ * FIFOBUF_CACHE_LIMIT_DFL blocks per size class, so a burst of more queued
+ * data than that is mostly malloc'ed again. For such pipelines, prefer the vm
+ * allocators, whose region is shared by all threads, or raise the limit.
+ */
+#define FIFOBUF_CACHE_LIMIT_DFL (64)
+void fifobuf_cache_set_limit(unsigned int limit);
+void fifobuf_cache_flush(void);
+
+/*
+ * Flags of fifobuf_vm_setup(). The region serves data blocks of the *_vm* variants.
+ */
+#define FIFOBUF_VM_HUGETLB (1 << 0) //!< Map hugetlb pages. (Needs reserved hugepages, see vm.nr_hugepages)
+#define FIFOBUF_VM_THP (1 << 1) //!< Advise transparent hugepages.
+#define FIFOBUF_VM_MLOCK (1 << 2) //!< Lock the region in memory. (Needs RLIMIT_MEMLOCK)
+int fifobuf_vm_setup(size_t size, unsigned int data_size, unsigned int flags);
+int fifobuf_vm_cleanup(void);
+
+int fifobuf_reserve(fifobuf_t *fb, unsigned int len, void **ptr);
+void fifobuf_commit(fifobuf_t *fb, unsigned int len);
+int fifobuf_peek(fifobuf_t *fb, void **ptr, unsigned int *len);
+unsigned int fifobuf_consume(fifobuf_t *fb, unsigned int len);
+
+int fifobuf_clone(fifobuf_t *dst, fifobuf_t *src);
+int fifobuf_splice(fifobuf_t *dst, fifobuf_t *src, unsigned int len);
+
+ssize_t fifobuf_writev(fifobuf_t *fb, int fd);
+ssize_t fifobuf_readv(fifobuf_t *fb, int fd, unsigned int len);
+
 typedef int (* fifobuf_ro_func_t)(void *data, unsigned int data_len, unsigned int offset, unsigned int total, void *priv);
 int fifobuf_ro(fifobuf_t *fb, fifobuf_ro_func_t ro_func, void *priv);
 
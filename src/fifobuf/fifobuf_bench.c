@@ -0,0 +1,157 @@
+/*
+ * fifobuf throughput benchmark.
+ *
+ * Usage: fifobuf_bench [total_mb]
+ *
+ * For each allocator, data block size and message size: enqueue messages until
+ * about 1MB is queued, dequeue them all, and repeat until total_mb is moved.
+ * The first 3 CSV columns identify a case, e.g. to join results of two commits.
+ *
+ * alloc: data blocks allocated by malloc per MB moved. Counted by wrapping
+ * malloc at link time (-Wl,--wrap=malloc), so blocks served by the per-thread
+ * cache or the vm region are not counted.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "fifobuf.h"
+
+#define BENCH_TOTAL_MB_DFL (64)
+#define BENCH_QUEUE_BYTES (1024 * 1024)
+#define BENCH_MSG_MAX (16384)
+#define BENCH_VM_REGION (8 * 1024 * 1024)
+
+static unsigned long bench_nr_malloc = 0;
+
+void *__real_malloc(size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	bench_nr_malloc++;
+	return __real_malloc(size);
+}
+
+typedef int (*bench_enqueue_t)(fifobuf_t *fb, void *data, unsigned int data_len);
+
+static const struct bench_alloc
+{
+	const char *name;
+	bench_enqueue_t enqueue;
+	int vm; //!< 1: set up a vm region (THP) for this case.
+} bench_alloc[] =
+{
+	{ "atomic", fifobuf_enqueue_atomic, 0 },
+	{ "sleep", fifobuf_enqueue_sleep, 0 },
+	{ "vm", fifobuf_enqueue_vm, 1 },
+};
+
+static const unsigned int bench_data_size[] = { 512, 4096, 65536 };
+static const unsigned int bench_msg_size[] = { 16, 256, 1500, 16384 };
+
+static uint8_t bench_msg[BENCH_MSG_MAX];
+static uint8_t bench_out[BENCH_MSG_MAX];
+
+static int bench_run(const struct bench_alloc *ba, const unsigned int data_size, const unsigned int msg_size, const unsigned long total)
+{
+	fifobuf_t fb;
+	unsigned long moved = 0, nr_malloc;
+	uint64_t t, ns_enq = 0, ns_deq = 0;
+	unsigned int i, depth;
+	double mb;
+
+	depth = BENCH_QUEUE_BYTES / msg_size;
+	if (depth == 0)
+	{
+		depth = 1;
+	}
+
+	if (ba->vm && fifobuf_vm_setup(BENCH_VM_REGION, data_size, FIFOBUF_VM_THP) < 0)
+	{
+		fprintf(stderr, "Cannot set up vm region. Use malloc.\n");
+	}
+
+	fifobuf_init(&fb, data_size);
+	fifobuf_cache_flush();
+	nr_malloc = bench_nr_malloc;
+
+	while (moved < total)
+	{
+		t = bench_now_ns();
+		for (i = 0; i < depth; i++)
+		{
+			if (ba->enqueue(&fb, bench_msg, msg_size) < 0)
+			{
+				fprintf(stderr, "Cannot enqueue (%s, %u, %u)\n", ba->name, data_size, msg_size);
+				fifobuf_exit(&fb);
+				fifobuf_vm_cleanup();
+				return -1;
+			}
+		}
+		ns_enq += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (i = 0; i < depth; i++)
+		{
+			if (fifobuf_dequeue(&fb, bench_out, msg_size) != msg_size)
+			{
+				fprintf(stderr, "Short dequeue (%s, %u, %u)\n", ba->name, data_size, msg_size);
+				fifobuf_exit(&fb);
+				fifobuf_vm_cleanup();
+				return -1;
+			}
+		}
+		ns_deq += bench_now_ns() - t;
+
+		moved += (unsigned long) depth * msg_size;
+	}
+
+	nr_malloc = bench_nr_malloc - nr_malloc;
+	fifobuf_exit(&fb);
+	fifobuf_vm_cleanup();
+
+	mb = (double) moved / (1024 * 1024);
+	printf("%s,%u,%u,%lu,%.1f,%.1f,%.2f\n", ba->name, data_size, msg_size, moved,
+		mb / ((double) ns_enq / 1e9), mb / ((double) ns_deq / 1e9), (double) nr_malloc / mb);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long total;
+	unsigned int a, d, m, data_size;
+
+	total = bench_arg(argc, argv, 1, BENCH_TOTAL_MB_DFL);
+	if (total == 0)
+	{
+		return bench_usage(argv[0], "[total_mb]");
+	}
+
+	total *= 1024 * 1024;
+	memset(bench_msg, 0x5a, sizeof(bench_msg));
+
+	printf("alloc,data_size,msg_size,bytes,enqueue_mbps,dequeue_mbps,alloc_per_mb\n");
+
+	for (a = 0; a < sizeof(bench_alloc) / sizeof(bench_alloc[0]); a++)
+	{
+		for (d = 0; d < sizeof(bench_data_size) / sizeof(bench_data_size[0]); d++)
+		{
+			data_size = fifobuf_calibrate_data_size(bench_data_size[d]);
+
+			for (m = 0; m < sizeof(bench_msg_size) / sizeof(bench_msg_size[0]); m++)
+			{
+				if (bench_run(&bench_alloc[a], data_size, bench_msg_size[m], total) < 0)
+				{
+					return 1;
+				}
+			}
+		}
+	}
+
+	fifobuf_cache_flush();
+	return 0;
+}
@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "fifobuf_cc.h"
+
+typedef struct fifobuf_cc_chunk
+{
+	struct fifobuf_cc_chunk *next; //!< Written once by producer (release), read by consumer (acquire).
+	unsigned int size; //!< Max available data size.
+	unsigned int len; //!< Published data size. Only grows.
+	unsigned int off; //!< Consumed data size. Consumer private.
+
+	uint8_t data[0];
+} fifobuf_cc_chunk_t;
+
+static fifobuf_cc_chunk_t *fifobuf_cc_chunk_alloc(const unsigned int size)
+{
+	fifobuf_cc_chunk_t *chunk;
+
+	chunk = malloc(sizeof(*chunk) + size);
+	if (chunk == NULL)
+	{
+		return NULL;
+	}
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->len = 0;
+	chunk->off = 0;
+
+	return chunk;
+}
+
+static inline int futex_wait(int *uaddr, int val, const struct timespec *ts)
+{
+	return syscall(SYS_futex, uaddr, FUTEX_WAIT_PRIVATE, val, ts, NULL, 0);
+}
+
+static inline int futex_wake(int *uaddr, int nr)
+{
+	return syscall(SYS_futex, uaddr, FUTEX_WAKE_PRIVATE, nr, NULL, NULL, 0);
+}
+
+/*
+ * Tell the consumer there is new data. Must be called after data is published.
+ *
+ * seq is the futex word, a plain int the kernel reads, so not an atomic_t.
+ * seq and waiters form a store-then-load handshake with the consumer, which
+ * needs seq_cst on both sides: they stay __atomic ops.
+ */
+static inline void fifobuf_cc_notify(fifobuf_cc_t *fbc)
+{
+	__atomic_add_fetch(&(fbc->seq), 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&(fbc->waiters), __ATOMIC_SEQ_CST))
+	{
+		futex_wake(&(fbc->seq), 1);
+	}
+}
+
+/*!
+ * \brief Init a concurrent fifobuf.
+ *
+ * \param fbc        fifobuf_cc ctx
+ * \param type       FIFOBUF_CC_SPSC or FIFOBUF_CC_MPSC
+ * \param chunk_size data size of each chunk (SPSC only)
+ *
+ * \return 0 if ok
+ * \return -1 if error
+ */
+int fifobuf_cc_init(fifobuf_cc_t *fbc, const fifobuf_cc_type_t type, const unsigned int chunk_size)
+{
+	fifobuf_cc_chunk_t *stub;
+
+	memset(fbc, 0x00, sizeof(*fbc));
+
+	fbc->type = type;
+	fbc->chunk_size = chunk_size ? chunk_size : FIFOBUF_CC_CHUNK_SIZE_DFL;
+
+	/* MPSC: an empty stub. SPSC: the first chunk to fill. */
+	stub = fifobuf_cc_chunk_alloc((type == FIFOBUF_CC_SPSC) ? fbc->chunk_size : 0);
+	if (stub == NULL)
+	{
+		return -1;
+	}
+
+	fbc->head = stub;
+	atomic_ptr_set(&(fbc->tail), stub);
+
+	return 0;
+}
+
+/*!
+ * \brief Exit a concurrent fifobuf. No producer/consumer may be running.
+ */
+void fifobuf_cc_exit(fifobuf_cc_t *fbc)
+{
+	fifobuf_cc_chunk_t *chunk, *next;
+
+	for (chunk = fbc->head; chunk; chunk = next)
+	{
+		next = chunk->next;
+		free(chunk);
+	}
+
+	fbc->head = NULL;
+	atomic_ptr_set(&(fbc->tail), NULL);
+}
+
+static int fifobuf_cc_enqueue_spsc(fifobuf_cc_t *fbc, const uint8_t *data, unsigned int data_len)
+{
+	fifobuf_cc_chunk_t *tail = atomic_ptr_read(&(fbc->tail)), *first = NULL, *last = NULL, *chunk;
+	unsigned int consume, space;
+
+	/*
+	 * Alloc all extra chunks first, so that nothing is published on failure.
+	 */
+	space = tail->size - tail->len;
+	if (data_len > space)
+	{
+		unsigned int need = data_len - space;
+
+		while (need)
+		{
+			chunk = fifobuf_cc_chunk_alloc(fbc->chunk_size);
+			if (chunk == NULL)
+			{
+				for (chunk = first; chunk; chunk = first)
+				{
+					first = chunk->next;
+					free(chunk);
+				}
+				return -1;
+			}
+
+			if (last)
+			{
+				last->next = chunk;
+			}
+			else
+			{
+				first = chunk;
+			}
+			last = chunk;
+
+			need -= (need > chunk->size) ? chunk->size : need;
+		}
+	}
+
+	/* Fill the tail chunk which may be read concurrently. */
+	consume = (data_len < space) ? data_len : space;
+	if (consume)
+	{
+		memcpy(tail->data + tail->len, data, consume);
+		smp_store_release(&(tail->len), tail->len + consume);
+
+		data += consume;
+		data_len -= consume;
+	}
+
+	if (first)
+	{
+		/* Fill private chunks, then hand them off at once. */
+		for (chunk = first; chunk; chunk = chunk->next)
+		{
+			consume = (data_len < chunk->size) ? data_len : chunk->size;
+			memcpy(chunk->data, data, consume);
+			chunk->len = consume;
+
+			data += consume;
+			data_len -= consume;
+		}
+
+		smp_store_release(&(tail->next), first);
+		atomic_ptr_set(&(fbc->tail), last);
+	}
+
+	return 0;
+}
+
+static int fifobuf_cc_enqueue_mpsc(fifobuf_cc_t *fbc, const uint8_t *data, unsigned int data_len)
+{
+	fifobuf_cc_chunk_t *chunk, *prev;
+
+	chunk = fifobuf_cc_chunk_alloc(data_len);
+	if (chunk == NULL)
+	{
+		return -1;
+	}
+
+	memcpy(chunk->data, data, data_len);
+	chunk->len = data_len;
+
+	/* Claim tail, then link. The consumer waits for the link if it catches up. */
+	prev = atomic_ptr_xchg(&(fbc->tail), chunk);
+	smp_store_release(&(prev->next), chunk);
+
+	return 0;
+}
+
+/*!
+ * \brief Enqueue data. (producer)
+ *
+ * \return 0 if ok
+ * \return -1 if cannot alloc memory. Nothing is enqueued.
+ */
+int fifobuf_cc_enqueue(fifobuf_cc_t *fbc, const void *data, unsigned int data_len)
+{
+	int ret;
+
+	if (data_len == 0)
+	{
+		return 0;
+	}
+
+	if (fbc->type == FIFOBUF_CC_SPSC)
+	{
+		ret = fifobuf_cc_enqueue_spsc(fbc, (const uint8_t *) data, data_len);
+	}
+	else
+	{
+		ret = fifobuf_cc_enqueue_mpsc(fbc, (const uint8_t *) data, data_len);
+	}
+
+	if (ret == 0)
+	{
+		fifobuf_cc_notify(fbc);
+	}
+
+	return ret;
+}
+
+/*!
+ * \brief Dequeue data without blocking. (consumer)
+ *
+ * \return Number of bytes dequeued to buf.
+ */
+unsigned int fifobuf_cc_dequeue(fifobuf_cc_t *fbc, uint8_t *buf, unsigned int buf_len)
+{
+	fifobuf_cc_chunk_t *head = fbc->head, *next;
+	unsigned int len, consume, consume_total = 0;
+
+	while (buf_len)
+	{
+		len = smp_load_acquire(&(head->len));
+		if (head->off < len)
+		{
+			consume = ((len - head->off) < buf_len) ? (len - head->off) : buf_len;
+			memcpy(buf, head->data + head->off, consume);
+
+			head->off += consume;
+			buf += consume;
+			buf_len -= consume;
+			consume_total += consume;
+			continue;
+		}
+
+		next = smp_load_acquire(&(head->next));
+		if (next == NULL)
+		{
+			break;
+		}
+
+		/* The producer might append more before handing off. */
+		if (head->off < smp_load_acquire(&(head->len)))
+		{
+			continue;
+		}
+
+		/* Producers never touch a chunk after linking its next. */
+		free(head);
+		head = next;
+	}
+
+	fbc->head = head;
+	return consume_total;
+}
+
+/*!
+ * \brief Dequeue data. Sleep if fifobuf is empty. (consumer)
+ *
+ * \param timeout_ms max time to sleep. < 0: forever
+ *
+ * \return Number of bytes dequeued to buf. 0 if timeout.
+ */
+unsigned int fifobuf_cc_dequeue_wait(fifobuf_cc_t *fbc, uint8_t *buf, unsigned int buf_len, int timeout_ms)
+{
+	struct timespec deadline, now, ts, *pts = NULL;
+	unsigned int consume;
+	int seq;
+
+	if (timeout_ms >= 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	for (;;)
+	{
+		seq = smp_load_acquire(&(fbc->seq));
+
+		consume = fifobuf_cc_dequeue(fbc, buf, buf_len);
+		if (consume)
+		{
+			return consume;
+		}
+
+		if (timeout_ms >= 0)
+		{
+			clock_gettime(CLOCK_MONOTONIC, &now);
+
+			ts.tv_sec = deadline.tv_sec - now.tv_sec;
+			ts.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+			if (ts.tv_nsec < 0)
+			{
+				ts.tv_sec--;
+				ts.tv_nsec += 1000000000;
+			}
+
+			if (ts.tv_sec < 0)
+			{
+				return 0;
+			}
+
+			pts = &ts;
+		}
+
+		/*
+		 * Announce sleep, then sleep only if nothing is published since seq.
+		 * A producer either sees waiters, or bumps seq before we sleep.
+		 */
+		__atomic_store_n(&(fbc->waiters), 1, __ATOMIC_SEQ_CST);
+		futex_wait(&(fbc->seq), seq, pts);
+		__atomic_store_n(&(fbc->waiters), 0, __ATOMIC_RELAXED);
+	}
+}
@@ -0,0 +1,64 @@
+
+#ifndef FIFOBUF_CC_H_
+#define FIFOBUF_CC_H_
+
+#include <stdint.h>
+
+#include "atomic/atomic.h"
+
+/*
+ * fifobuf_cc: a concurrent fifobuf for producer/consumer pipelines.
+ *
+ *   head (consumer)                              tail (producer)
+ *     |                                            |
+ *     v                                            v
+ *   +-------+    +-------+        +-------+    +-------+
+ *   | chunk | -> | chunk | -> ... | chunk | -> | chunk | -> NULL
+ *   +-------+    +-------+        +-------+    +-------+
+ *
+ * - SPSC: the producer appends into the tail chunk and publishes its fill
+ *   level with a release store. A full chunk is handed off by linking a new
+ *   one after it. No lock, no CAS.
+ * - MPSC: each enqueue is one chunk, linked by an atomic exchange on tail.
+ *   Messages from one producer are never interleaved with others.
+ *
+ * There is always one consumer. It may sleep on a futex while the queue is
+ * empty (fifobuf_cc_dequeue_wait). Producers only issue a wake-up syscall when
+ * the consumer is actually sleeping.
+ */
+typedef enum
+{
+	FIFOBUF_CC_SPSC = 0,
+	FIFOBUF_CC_MPSC,
+} fifobuf_cc_type_t;
+
+struct fifobuf_cc_chunk;
+
+#define FIFOBUF_CC_CACHELINE (64)
+
+typedef struct fifobuf_cc
+{
+	/* Consumer side */
+	struct fifobuf_cc_chunk *head __attribute__((aligned(FIFOBUF_CC_CACHELINE)));
+
+	/* Producer side */
+	atomic_ptr_t tail __attribute__((aligned(FIFOBUF_CC_CACHELINE))); //!< Last chunk. Exchanged by MPSC producers.
+	unsigned int chunk_size; //!< Data size of SPSC chunks.
+	fifobuf_cc_type_t type;
+
+	/* Consumer wait */
+	int seq __attribute__((aligned(FIFOBUF_CC_CACHELINE))); //!< Bumped on every publish. futex word.
+	int waiters; //!< 1 if consumer is (going to) sleep.
+} fifobuf_cc_t;
+
+#define FIFOBUF_CC_CHUNK_SIZE_DFL (4096)
+
+int fifobuf_cc_init(fifobuf_cc_t *fbc, const fifobuf_cc_type_t type, const unsigned int chunk_size);
+void fifobuf_cc_exit(fifobuf_cc_t *fbc);
+
+int fifobuf_cc_enqueue(fifobuf_cc_t *fbc, const void *data, unsigned int data_len);
+
+unsigned int fifobuf_cc_dequeue(fifobuf_cc_t *fbc, uint8_t *buf, unsigned int buf_len);
+unsigned int fifobuf_cc_dequeue_wait(fifobuf_cc_t *fbc, uint8_t *buf, unsigned int buf_len, int timeout_ms);
+
+#endif /* FIFOBUF_CC_H_ */
@@ -0,0 +1,345 @@
+/*!
+ * \file flatmap.h
+ * \brief Open addressing hash map (SwissTable layout), generated per key and value type.
+ *
+ * \details
+ * Keys and values are stored inline in one slot array, next to an array of
+ * one control byte per slot: empty, deleted, or the low 7 bits of the hash
+ * (h2) of a full slot. A lookup starts at a slot chosen by the rest of the
+ * hash (h1) and compares 16 control bytes at once with SSE2 (a plain loop
+ * without it). Only slots whose h2 matches are compared by key, so a probe
+ * costs one cache line of control bytes rather than a pointer chase per
+ * entry, as in a chained hlist table. Groups are probed quadratically until
+ * one holds an empty byte.
+ *
+ * Meant for small fixed-size keys (ids, 5-tuples). Not thread-safe. Pointers
+ * to values stay valid until the next insert.
+ *
+ * \par Example:
+ * \code
+FLATMAP_DEFINE(idmap, uint64_t, struct conn *, flatmap_hash_u64, FLATMAP_EQ_NUM)
+
+struct idmap map;
+struct conn **pc;
+
+idmap_init(&map, 1024);
+idmap_insert(&map, id, conn);  // 0 if ok, 1 if id is there, -1 if no memory
+pc = idmap_find(&map, id);     // NULL if not found
+idmap_erase(&map, id);
+idmap_exit(&map);
+ * \endcode
+ */
+
+#ifndef FLATMAP_H_
+#define FLATMAP_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "hash/hash.h"
+
+#define FLATMAP_GROUP (16) //!< Control bytes probed at once
+#define FLATMAP_CAP_MIN FLATMAP_GROUP
+
+#define FLATMAP_EMPTY ((int8_t) -128)
+#define FLATMAP_DELETED ((int8_t) -2)
+
+#define FLATMAP_EQ_NUM(_a, _b) ((_a) == (_b))
+#define FLATMAP_EQ_MEM(_a, _b) (memcmp(&(_a), &(_b), sizeof(_a)) == 0)
+
+/*!
+ * \brief Hash of a 64-bit key. (murmur3 finalizer)
+ */
+static inline uint64_t flatmap_hash_u64(uint64_t k)
+{
+	return hash_mix64(k);
+}
+
+/*!
+ * \brief Hash of a byte string, e.g. a packed 5-tuple. (FNV-1a, then mixed)
+ */
+static inline uint64_t flatmap_hash_mem(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint64_t h = 14695981039346656037ULL;
+
+	while (len--)
+	{
+		h ^= *p++;
+		h *= 1099511628211ULL;
+	}
+
+	return flatmap_hash_u64(h);
+}
+
+/*
+ * Group primitives. Bit i of the result stands for ctrl[i].
+ */
+static inline uint32_t flatmap_group_match(const int8_t *ctrl, const int8_t h2)
+{
+#ifdef __SSE2__
+	__m128i g = _mm_loadu_si128((const __m128i *) ctrl);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(h2)));
+#else
+	uint32_t bits = 0;
+	int i;
+
+	for (i = 0; i < FLATMAP_GROUP; i++)
+		bits |= (uint32_t) (ctrl[i] == h2) << i;
+
+	return bits;
+#endif
+}
+
+static inline uint32_t flatmap_group_empty(const int8_t *ctrl)
+{
+	return flatmap_group_match(ctrl, FLATMAP_EMPTY);
+}
+
+/* Empty or deleted: the only control values below -1 */
+static inline uint32_t flatmap_group_free(const int8_t *ctrl)
+{
+#ifdef __SSE2__
+	__m128i g = _mm_loadu_si128((const __m128i *) ctrl);
+
+	return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), g));
+#else
+	uint32_t bits = 0;
+	int i;
+
+	for (i = 0; i < FLATMAP_GROUP; i++)
+		bits |= (uint32_t) (ctrl[i] < -1) << i;
+
+	return bits;
+#endif
+}
+
+/*
+ * The first FLATMAP_GROUP bytes are mirrored after the last one, so a group
+ * load never wraps.
+ */
+static inline void flatmap_ctrl_set(int8_t *ctrl, const size_t mask, const size_t i, const int8_t v)
+{
+	ctrl[i] = v;
+	if (i < FLATMAP_GROUP)
+		ctrl[mask + 1 + i] = v;
+}
+
+/* First free slot on the probe sequence of hash. There always is one. */
+static inline size_t flatmap_find_free(const int8_t *ctrl, const size_t mask, const uint64_t hash)
+{
+	size_t pos = (hash >> 7) & mask, stride = 0;
+	uint32_t bits;
+
+	while ((bits = flatmap_group_free(ctrl + pos)) == 0)
+	{
+		stride += FLATMAP_GROUP;
+		pos = (pos + stride) & mask;
+	}
+
+	return (pos + __builtin_ctz(bits)) & mask;
+}
+
+/*
+ * A slot may go back to empty, rather than deleted, if no probe ever passed
+ * over it: no group covering it was ever full.
+ */
+static inline int flatmap_was_never_full(const int8_t *ctrl, const size_t mask, const size_t i)
+{
+	uint32_t after = flatmap_group_empty(ctrl + i);
+	uint32_t before = flatmap_group_empty(ctrl + ((i - FLATMAP_GROUP) & mask));
+
+	return after && before &&
+		(unsigned int) __builtin_ctz(after) + (__builtin_clz(before) - (32 - FLATMAP_GROUP)) < FLATMAP_GROUP;
+}
+
+/*
+ * Iterate full slots. slot is a struct name##_slot *, pos a size_t.
+ */
+#define flatmap_for_each(name, map, slot, pos) \
+	for (pos = 0; (slot = name##_iter((map), &pos)) != NULL; )
+
+#define FLATMAP_DEFINE(name, ktype, vtype, hash_fn, eq_fn) \
+\
+typedef ktype name##_key_t; \
+typedef vtype name##_val_t; \
+\
+struct name##_slot \
+{ \
+	ktype key; \
+	vtype val; \
+}; \
+\
+struct name \
+{ \
+	int8_t *ctrl; \
+	struct name##_slot *slots; \
+	size_t mask; /* Capacity - 1 */ \
+	size_t size; \
+	size_t growth_left; /* Empty slots we may still fill, keeping load <= 7/8 */ \
+}; \
+\
+static inline int name##_alloc(struct name *m, size_t cap) \
+{ \
+	m->ctrl = malloc(cap + FLATMAP_GROUP); \
+	m->slots = malloc(cap * sizeof(struct name##_slot)); \
+	if (m->ctrl == NULL || m->slots == NULL) \
+	{ \
+		free(m->ctrl); \
+		free(m->slots); \
+		return -1; \
+	} \
+\
+	memset(m->ctrl, FLATMAP_EMPTY, cap + FLATMAP_GROUP); \
+	m->mask = cap - 1; \
+	m->size = 0; \
+	m->growth_left = cap - cap / 8; \
+	return 0; \
+} \
+\
+/* Init with room for at least nr entries. 0 if ok, -1 if no memory. */ \
+static inline int name##_init(struct name *m, const size_t nr) \
+{ \
+	size_t cap = FLATMAP_CAP_MIN; \
+\
+	while (cap - cap / 8 < nr) \
+		cap *= 2; \
+\
+	return name##_alloc(m, cap); \
+} \
+\
+static inline void name##_exit(struct name *m) \
+{ \
+	free(m->ctrl); \
+	free(m->slots); \
+	m->ctrl = NULL; \
+	m->slots = NULL; \
+	m->size = 0; \
+} \
+\
+/* Move all entries to fresh arrays of cap slots. Drops deleted slots. */ \
+static inline int name##_resize(struct name *m, const size_t cap) \
+{ \
+	struct name new; \
+	size_t i, j; \
+	uint64_t hash; \
+\
+	if (name##_alloc(&new, cap)) \
+		return -1; \
+\
+	for (i = 0; i <= m->mask; i++) \
+	{ \
+		if (m->ctrl[i] < 0) \
+			continue; \
+\
+		hash = hash_fn(m->slots[i].key); \
+		j = flatmap_find_free(new.ctrl, new.mask, hash); \
+		flatmap_ctrl_set(new.ctrl, new.mask, j, hash & 0x7f); \
+		new.slots[j] = m->slots[i]; \
+	} \
+\
+	new.size = m->size; \
+	new.growth_left -= m->size; \
+	name##_exit(m); \
+	*m = new; \
+	return 0; \
+} \
+\
+static inline size_t name##_find_index(const struct name *m, const name##_key_t key, const uint64_t hash) \
+{ \
+	size_t pos = (hash >> 7) & m->mask, stride = 0, i; \
+	const int8_t h2 = hash & 0x7f; \
+	uint32_t bits; \
+\
+	for (;;) \
+	{ \
+		for (bits = flatmap_group_match(m->ctrl + pos, h2); bits; bits &= bits - 1) \
+		{ \
+			i = (pos + __builtin_ctz(bits)) & m->mask; \
+			if (eq_fn(m->slots[i].key, key)) \
+				return i; \
+		} \
+\
+		if (flatmap_group_empty(m->ctrl + pos)) \
+			return (size_t) -1; \
+\
+		stride += FLATMAP_GROUP; \
+		pos = (pos + stride) & m->mask; \
+	} \
+} \
+\
+/* Value of key, or NULL if not found */ \
+static inline vtype *name##_find(const struct name *m, const name##_key_t key) \
+{ \
+	size_t i = name##_find_index(m, key, hash_fn(key)); \
+\
+	return i == (size_t) -1 ? NULL : &m->slots[i].val; \
+} \
+\
+/* 0 if inserted, 1 if key is there (its value is kept), -1 if no memory */ \
+static inline int name##_insert(struct name *m, const name##_key_t key, const name##_val_t val) \
+{ \
+	const uint64_t hash = hash_fn(key); \
+	size_t i, cap = m->mask + 1; \
+\
+	if (name##_find_index(m, key, hash) != (size_t) -1) \
+		return 1; \
+\
+	i = flatmap_find_free(m->ctrl, m->mask, hash); \
+	if (m->growth_left == 0 && m->ctrl[i] == FLATMAP_EMPTY) \
+	{ \
+		/* Mostly deleted slots: clean up in place. Else grow. */ \
+		if (name##_resize(m, m->size * 16 < cap * 7 ? cap : cap * 2)) \
+			return -1; \
+		i = flatmap_find_free(m->ctrl, m->mask, hash); \
+	} \
+\
+	m->growth_left -= (m->ctrl[i] == FLATMAP_EMPTY); \
+	flatmap_ctrl_set(m->ctrl, m->mask, i, hash & 0x7f); \
+	m->slots[i].key = key; \
+	m->slots[i].val = val; \
+	m->size++; \
+	return 0; \
+} \
+\
+/* 0 if erased, -1 if not found */ \
+static inline int name##_erase(struct name *m, const name##_key_t key) \
+{ \
+	size_t i = name##_find_index(m, key, hash_fn(key)); \
+\
+	if (i == (size_t) -1) \
+		return -1; \
+\
+	if (flatmap_was_never_full(m->ctrl, m->mask, i)) \
+	{ \
+		flatmap_ctrl_set(m->ctrl, m->mask, i, FLATMAP_EMPTY); \
+		m->growth_left++; \
+	} \
+	else \
+	{ \
+		flatmap_ctrl_set(m->ctrl, m->mask, i, FLATMAP_DELETED); \
+	} \
+\
+	m->size--; \
+	return 0; \
+} \
+\
+/* Next full slot at or after *pos, or NULL. Advances *pos past it. */ \
+static inline struct name##_slot *name##_iter(const struct name *m, size_t *pos) \
+{ \
+	for (; *pos <= m->mask; (*pos)++) \
+	{ \
+		if (m->ctrl[*pos] >= 0) \
+			return &m->slots[(*pos)++]; \
+	} \
+\
+	return NULL; \
+}
+
+#endif /* FLATMAP_H_ */
@@ -0,0 +1,238 @@
+/*
+ * flatmap vs hashtab (hlist chains) vs rbtree benchmark.
+ *
+ * Usage: flatmap_bench [perf_loops [nodes]]
+ *
+ * NODES unique random 64-bit ids are inserted, looked up in random order,
+ * looked up again with ids that are not there, and erased, PERF_LOOPS times,
+ * in each map. The value is a pointer to the object. hashtab also pays for
+ * its stripe lock, uncontended, as it would in use.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "hashtab/hashtab.h"
+#include "rbtree/rbtree_map.h"
+#include "flatmap.h"
+
+#define NODES       1000000
+#define PERF_LOOPS  10
+
+struct bench_obj
+{
+	uint64_t id;
+	struct hashtab_node hnode;
+	struct rb_node rb;
+};
+
+FLATMAP_DEFINE(bench_fm, uint64_t, struct bench_obj *, flatmap_hash_u64, FLATMAP_EQ_NUM)
+RB_DEFINE_MAP(bench_rb, struct bench_obj, rb, id, RB_MAP_CMP_NUM)
+
+static struct bench_obj *objs;
+static unsigned int *order; //!< Random permutation of objs[] index
+static unsigned int nr_nodes = NODES;
+
+/* Ids of objs[] are odd, so id + 1 always misses. */
+#define MISS_ID(_j) (objs[order[_j]].id + 1)
+
+static int bench_ht_match(const struct hashtab_node *node, const void *key)
+{
+	return hashtab_entry(node, struct bench_obj, hnode)->id == *(const uint64_t *) key;
+}
+
+static unsigned long bench_flatmap(const unsigned int loops)
+{
+	struct bench_fm fm;
+	struct bench_obj **pobj;
+	uint64_t t, ns_insert = 0, ns_lookup = 0, ns_miss = 0, ns_erase = 0, id;
+	unsigned long err = 0;
+	unsigned int i, j;
+
+	if (bench_fm_init(&fm, 0))
+		return 1;
+
+	for (i = 0; i < loops; i++)
+	{
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			err += (bench_fm_insert(&fm, objs[j].id, objs + j) != 0);
+		ns_insert += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+		{
+			pobj = bench_fm_find(&fm, objs[order[j]].id);
+			err += (pobj == NULL || *pobj != objs + order[j]);
+		}
+		ns_lookup += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			err += (bench_fm_find(&fm, MISS_ID(j)) != NULL);
+		ns_miss += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+		{
+			id = objs[j].id;
+			err += (bench_fm_erase(&fm, id) != 0);
+		}
+		ns_erase += bench_now_ns() - t;
+	}
+
+	bench_fm_exit(&fm);
+
+	bench_print_result("flatmap", "insert", ns_insert, nr_nodes, loops);
+	bench_print_result("flatmap", "lookup", ns_lookup, nr_nodes, loops);
+	bench_print_result("flatmap", "lookup_miss", ns_miss, nr_nodes, loops);
+	bench_print_result("flatmap", "erase", ns_erase, nr_nodes, loops);
+
+	return err;
+}
+
+static unsigned long bench_hashtab(const unsigned int loops)
+{
+	hashtab_t ht;
+	struct hashtab_node *node;
+	uint64_t t, ns_insert = 0, ns_lookup = 0, ns_miss = 0, ns_erase = 0, id;
+	unsigned long err = 0;
+	unsigned int i, j;
+
+	if (hashtab_init(&ht, 0, 0))
+		return 1;
+
+	for (i = 0; i < loops; i++)
+	{
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			err += (hashtab_insert(&ht, &objs[j].hnode, hashtab_hash_u64(objs[j].id), &objs[j].id, bench_ht_match) != NULL);
+		ns_insert += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+		{
+			id = objs[order[j]].id;
+			node = hashtab_lookup(&ht, hashtab_hash_u64(id), &id, bench_ht_match);
+			err += (node != &objs[order[j]].hnode);
+		}
+		ns_lookup += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+		{
+			id = MISS_ID(j);
+			err += (hashtab_lookup(&ht, hashtab_hash_u64(id), &id, bench_ht_match) != NULL);
+		}
+		ns_miss += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			hashtab_remove(&ht, &objs[j].hnode);
+		ns_erase += bench_now_ns() - t;
+	}
+
+	err += (hashtab_count(&ht) != 0);
+	hashtab_exit(&ht);
+
+	bench_print_result("hashtab", "insert", ns_insert, nr_nodes, loops);
+	bench_print_result("hashtab", "lookup", ns_lookup, nr_nodes, loops);
+	bench_print_result("hashtab", "lookup_miss", ns_miss, nr_nodes, loops);
+	bench_print_result("hashtab", "erase", ns_erase, nr_nodes, loops);
+
+	return err;
+}
+
+static unsigned long bench_rbtree(const unsigned int loops)
+{
+	struct rb_root root = RB_ROOT;
+	uint64_t t, ns_insert = 0, ns_lookup = 0, ns_miss = 0, ns_erase = 0;
+	unsigned long err = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < loops; i++)
+	{
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			err += (bench_rb_insert(&root, objs + j) != NULL);
+		ns_insert += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			err += (bench_rb_find(&root, objs[order[j]].id) != objs + order[j]);
+		ns_lookup += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			err += (bench_rb_find(&root, MISS_ID(j)) != NULL);
+		ns_miss += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			bench_rb_erase(&root, objs + j);
+		ns_erase += bench_now_ns() - t;
+	}
+
+	err += !RB_EMPTY_ROOT(&root);
+
+	bench_print_result("rbtree", "insert", ns_insert, nr_nodes, loops);
+	bench_print_result("rbtree", "lookup", ns_lookup, nr_nodes, loops);
+	bench_print_result("rbtree", "lookup_miss", ns_miss, nr_nodes, loops);
+	bench_print_result("rbtree", "erase", ns_erase, nr_nodes, loops);
+
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int loops = PERF_LOOPS, j, k, tmp;
+	unsigned long err = 0;
+
+	loops = bench_arg(argc, argv, 1, PERF_LOOPS);
+	nr_nodes = bench_arg(argc, argv, 2, NODES);
+	if (loops == 0 || nr_nodes == 0)
+	{
+		return bench_usage(argv[0], "[perf_loops [nodes]]");
+	}
+
+	objs = calloc(nr_nodes, sizeof(*objs));
+	order = calloc(nr_nodes, sizeof(*order));
+	if (objs == NULL || order == NULL)
+	{
+		return 1;
+	}
+
+	/* Unique, odd, scattered ids */
+	for (j = 0; j < nr_nodes; j++)
+	{
+		objs[j].id = (flatmap_hash_u64(j) << 1) | 1;
+		order[j] = j;
+	}
+
+	for (j = nr_nodes - 1; j > 0; j--)
+	{
+		k = random() % (j + 1);
+		tmp = order[j];
+		order[j] = order[k];
+		order[k] = tmp;
+	}
+
+	printf("map,op,nodes,loops,ns_per_op\n");
+
+	err += bench_flatmap(loops);
+	err += bench_hashtab(loops);
+	err += bench_rbtree(loops);
+
+	free(order);
+	free(objs);
+
+	if (err)
+	{
+		fprintf(stderr, "BUG: %lu wrong results\n", err);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+/*!
+ * \file hash.h
+ * \brief Hash helpers shared by hashtab and flatmap.
+ */
+
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <stdint.h>
+
+/*!
+ * \brief Mix all bits of a 64-bit value into all bits of the result. (murmur3 finalizer)
+ *
+ * \details Good as a hash of an integer key, and to spread a weaker hash.
+ * Take the low bits for a narrower hash.
+ */
+static inline uint64_t hash_mix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+
+	return k;
+}
+
+#endif /* HASH_H_ */
@@ -0,0 +1,392 @@
+/*!
+ * \file hashtab.c
+ * \brief Resizable, thread-safe, intrusive hash table on list.h hlist.
+ *
+ * \details
+ * A hash h lives in bucket h & mask[0] of tbl[0], unless a rehash is running
+ * and that bucket is below rehash_idx: then it lives in h & mask[1] of tbl[1].
+ * Both buckets belong to stripe h & lock_mask, since lock_mask <= mask[0] <
+ * mask[1]. So the stripe lock of h is all it takes to find, add or remove h,
+ * and moving old bucket b under stripe b & lock_mask is invisible to others.
+ *
+ * tbl[1], mask[1] and rehash_idx change outside of stripe locks (under
+ * resize_lock), hence the atomics. tbl[0] and mask[0] change with every
+ * stripe held, so holding any one keeps them stable.
+ *
+ * \sa hashtab.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "hashtab.h"
+
+#define HASHTAB_LOCKS_DEFAULT (64)
+
+static inline unsigned int pow2_adjust(unsigned int x)
+{
+	x--;
+	x |= x >> 1;
+	x |= x >> 2;
+	x |= x >> 4;
+	x |= x >> 8;
+	x |= x >> 16;
+
+	return (x + 1);
+}
+
+static inline pthread_mutex_t *hashtab_lock_of(hashtab_t *ht, const uint32_t hash)
+{
+	return &ht->locks[hash & ht->lock_mask].lock;
+}
+
+/*
+ * Bucket of hash. The stripe lock of hash must be held.
+ */
+static inline struct hlist_head *hashtab_bucket(hashtab_t *ht, const uint32_t hash)
+{
+	struct hlist_head *new = smp_load_acquire(&ht->tbl[1]);
+
+	if (new && (hash & ht->mask[0]) < READ_ONCE(ht->rehash_idx))
+	{
+		return &new[hash & READ_ONCE(ht->mask[1])];
+	}
+
+	return &ht->tbl[0][hash & ht->mask[0]];
+}
+
+static inline struct hashtab_node *hashtab_find(struct hlist_head *head, const uint32_t hash, const void *key, hashtab_match_t match)
+{
+	struct hlist_node *pos;
+	struct hashtab_node *node;
+
+	for (pos = head->first; pos; pos = pos->next)
+	{
+		node = hlist_entry(pos, struct hashtab_node, hlist);
+		if (node->hash == hash && match(node, key))
+		{
+			return node;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Init a table.
+ * \param ht The table to init
+ * \param size Initial bucket count. Round up to a power of 2, at least nr_locks.
+ * \param nr_locks Stripe lock count. Round up to a power of 2. 0 for default.
+ * \return 0 if ok
+ * \return < 0 if error
+ */
+int hashtab_init(hashtab_t *ht, unsigned int size, unsigned int nr_locks)
+{
+	unsigned int i;
+
+	assert(ht != NULL);
+
+	if (nr_locks == 0)
+	{
+		nr_locks = HASHTAB_LOCKS_DEFAULT;
+	}
+
+	if (size > (1U << 30) || nr_locks > (1U << 16))
+	{
+		return -1;
+	}
+
+	nr_locks = pow2_adjust(nr_locks);
+	size = pow2_adjust(size < nr_locks ? nr_locks : size);
+
+	ht->tbl[0] = calloc(size, sizeof(struct hlist_head));
+	if (ht->tbl[0] == NULL)
+	{
+		return -1;
+	}
+
+	if (posix_memalign((void **) &ht->locks, HASHTAB_CACHELINE, nr_locks * sizeof(struct hashtab_lock)))
+	{
+		free(ht->tbl[0]);
+		return -1;
+	}
+
+	for (i = 0; i < nr_locks; i++)
+	{
+		pthread_mutex_init(&ht->locks[i].lock, NULL);
+	}
+
+	ht->tbl[1] = NULL;
+	ht->mask[0] = size - 1;
+	ht->mask[1] = 0;
+	ht->rehash_idx = 0;
+	ht->lock_mask = nr_locks - 1;
+	atomic64_set(&ht->count, 0);
+	pthread_mutex_init(&ht->resize_lock, NULL);
+
+	return 0;
+}
+
+/*!
+ * \brief Release a table. Nodes still in it are left alone. See hashtab_flush().
+ */
+void hashtab_exit(hashtab_t *ht)
+{
+	unsigned int i;
+
+	assert(ht != NULL);
+
+	for (i = 0; i <= ht->lock_mask; i++)
+	{
+		pthread_mutex_destroy(&ht->locks[i].lock);
+	}
+
+	pthread_mutex_destroy(&ht->resize_lock);
+	free(ht->locks);
+	free(ht->tbl[1]);
+	free(ht->tbl[0]);
+	ht->locks = NULL;
+	ht->tbl[0] = ht->tbl[1] = NULL;
+}
+
+hashtab_t *hashtab_create(unsigned int size, unsigned int nr_locks)
+{
+	hashtab_t *ht = malloc(sizeof(hashtab_t));
+
+	if (ht && hashtab_init(ht, size, nr_locks))
+	{
+		free(ht);
+		ht = NULL;
+	}
+
+	return ht;
+}
+
+void hashtab_destroy(hashtab_t *ht)
+{
+	if (ht)
+	{
+		hashtab_exit(ht);
+		free(ht);
+	}
+}
+
+/*
+ * Start a rehash into twice the buckets. Caller holds resize_lock.
+ */
+static void hashtab_grow(hashtab_t *ht)
+{
+	struct hlist_head *new;
+	unsigned int size = ht->mask[0] + 1;
+
+	if (ht->tbl[1] || size > (1U << 30) || atomic64_read(&ht->count) <= size)
+	{
+		return;
+	}
+
+	new = calloc(2 * size, sizeof(struct hlist_head));
+	if (new == NULL)
+	{
+		/* Keep working with long chains. Retried on the next insert. */
+		return;
+	}
+
+	WRITE_ONCE(ht->mask[1], 2 * size - 1);
+	WRITE_ONCE(ht->rehash_idx, 0);
+	smp_store_release(&ht->tbl[1], new);
+}
+
+/*
+ * Move up to nr old buckets, and finish the rehash once all are moved.
+ * Caller holds resize_lock.
+ */
+static void hashtab_rehash_step(hashtab_t *ht, unsigned int nr)
+{
+	struct hlist_head *old, *new = ht->tbl[1];
+	struct hlist_node *pos, *n;
+	struct hashtab_node *node;
+	pthread_mutex_t *lock;
+	unsigned int idx, i;
+
+	if (new == NULL)
+	{
+		return;
+	}
+
+	for (idx = ht->rehash_idx; nr && idx <= ht->mask[0]; nr--, idx++)
+	{
+		lock = hashtab_lock_of(ht, idx);
+		pthread_mutex_lock(lock);
+
+		old = &ht->tbl[0][idx];
+		for (pos = old->first; pos && ({ n = pos->next; 1; }); pos = n)
+		{
+			node = hlist_entry(pos, struct hashtab_node, hlist);
+			__hlist_del(pos);
+			hlist_add_head(pos, &new[node->hash & ht->mask[1]]);
+		}
+
+		WRITE_ONCE(ht->rehash_idx, idx + 1);
+		pthread_mutex_unlock(lock);
+	}
+
+	if (idx <= ht->mask[0])
+	{
+		return;
+	}
+
+	/* All moved. Swap under every stripe: O(stripes), whatever the node count. */
+	for (i = 0; i <= ht->lock_mask; i++)
+	{
+		pthread_mutex_lock(&ht->locks[i].lock);
+	}
+
+	old = ht->tbl[0];
+	ht->tbl[0] = new;
+	WRITE_ONCE(ht->mask[0], ht->mask[1]);
+	WRITE_ONCE(ht->tbl[1], NULL);
+	WRITE_ONCE(ht->rehash_idx, 0);
+
+	for (i = 0; i <= ht->lock_mask; i++)
+	{
+		pthread_mutex_unlock(&ht->locks[i].lock);
+	}
+
+	free(old);
+}
+
+/*
+ * Give the rehash some work, without waiting for another thread doing it.
+ */
+static inline void hashtab_rehash_help(hashtab_t *ht)
+{
+	unsigned int size = READ_ONCE(ht->mask[0]) + 1;
+
+	if (READ_ONCE(ht->tbl[1]) == NULL && atomic64_read(&ht->count) <= size)
+	{
+		return;
+	}
+
+	if (pthread_mutex_trylock(&ht->resize_lock))
+	{
+		return;
+	}
+
+	hashtab_grow(ht);
+	hashtab_rehash_step(ht, HASHTAB_REHASH_STEP);
+	pthread_mutex_unlock(&ht->resize_lock);
+}
+
+/*!
+ * \brief Finish a running rehash now, e.g. before a read-mostly phase.
+ */
+void hashtab_rehash(hashtab_t *ht)
+{
+	pthread_mutex_lock(&ht->resize_lock);
+	hashtab_rehash_step(ht, ~0U);
+	pthread_mutex_unlock(&ht->resize_lock);
+}
+
+/*!
+ * \brief Insert a node.
+ * \param ht The table
+ * \param node The node to insert
+ * \param hash Hash of the node's key
+ * \param key The node's key, passed to match()
+ * \param match Key compare. NULL to skip the duplicate check.
+ * \return NULL if inserted
+ * \return the node already holding key. node is not inserted.
+ */
+struct hashtab_node *hashtab_insert(hashtab_t *ht, struct hashtab_node *node, const uint32_t hash, const void *key, hashtab_match_t match)
+{
+	pthread_mutex_t *lock = hashtab_lock_of(ht, hash);
+	struct hlist_head *head;
+	struct hashtab_node *old;
+
+	pthread_mutex_lock(lock);
+	head = hashtab_bucket(ht, hash);
+
+	if (match && (old = hashtab_find(head, hash, key, match)) != NULL)
+	{
+		pthread_mutex_unlock(lock);
+		return old;
+	}
+
+	node->hash = hash;
+	hlist_add_head(&node->hlist, head);
+	pthread_mutex_unlock(lock);
+
+	(void) atomic64_add_return_relaxed(1, &ht->count);
+	hashtab_rehash_help(ht);
+
+	return NULL;
+}
+
+/*!
+ * \brief Find the node of key.
+ * \return node, or NULL if not found
+ * \note The node is returned after the bucket lock is dropped. If other
+ * threads may remove and free it, take a reference in match().
+ */
+struct hashtab_node *hashtab_lookup(hashtab_t *ht, const uint32_t hash, const void *key, hashtab_match_t match)
+{
+	pthread_mutex_t *lock = hashtab_lock_of(ht, hash);
+	struct hashtab_node *node;
+
+	pthread_mutex_lock(lock);
+	node = hashtab_find(hashtab_bucket(ht, hash), hash, key, match);
+	pthread_mutex_unlock(lock);
+
+	return node;
+}
+
+/*!
+ * \brief Remove a node, which must be in the table.
+ */
+void hashtab_remove(hashtab_t *ht, struct hashtab_node *node)
+{
+	pthread_mutex_t *lock = hashtab_lock_of(ht, node->hash);
+
+	/* The node knows its own bucket by pprev, whichever array it is in. */
+	pthread_mutex_lock(lock);
+	hlist_del_init(&node->hlist);
+	pthread_mutex_unlock(lock);
+
+	(void) atomic64_sub_return_relaxed(1, &ht->count);
+	hashtab_rehash_help(ht);
+}
+
+/*!
+ * \brief Remove all nodes, calling free_fn(node, arg) on each. free_fn may free it.
+ * \note Not to be run with other calls on the table.
+ */
+void hashtab_flush(hashtab_t *ht, void (*free_fn)(struct hashtab_node *node, void *arg), void *arg)
+{
+	struct hlist_node *pos, *n;
+	unsigned int t, i;
+
+	for (t = 0; t < 2; t++)
+	{
+		if (ht->tbl[t] == NULL)
+		{
+			continue;
+		}
+
+		for (i = 0; i <= ht->mask[t]; i++)
+		{
+			for (pos = ht->tbl[t][i].first; pos && ({ n = pos->next; 1; }); pos = n)
+			{
+				INIT_HLIST_NODE(pos);
+				if (free_fn)
+				{
+					free_fn(hlist_entry(pos, struct hashtab_node, hlist), arg);
+				}
+			}
+
+			INIT_HLIST_HEAD(&ht->tbl[t][i]);
+		}
+	}
+
+	atomic64_set(&ht->count, 0);
+}
@@ -0,0 +1,131 @@
+/*!
+ * \file hashtab.h
+ * \brief Resizable, thread-safe, intrusive hash table on list.h hlist.
+ *
+ * \details
+ * Objects embed a struct hashtab_node, like an hlist_node, so the table never
+ * allocates per object and works with objects from mempool or anywhere else.
+ *
+ * - Buckets are guarded by a fixed array of striped locks. The stripe of a
+ *   hash is its low bits, and the table never has fewer buckets than stripes,
+ *   so one stripe covers the same hashes before, during and after a resize.
+ * - The table doubles when it holds more nodes than buckets. The rehash is
+ *   incremental: the old and new bucket arrays live side by side, and every
+ *   insert or remove moves HASHTAB_REHASH_STEP old buckets under their own
+ *   stripe lock. Only the final swap of the arrays takes all stripes, which
+ *   costs O(stripes), not O(nodes).
+ * - The caller computes the hash (see hashtab_hash_u64() and
+ *   hashtab_hash_mem()) and gives a match() callback to compare keys.
+ *
+ * \par Example:
+ * \code
+struct conn
+{
+	uint64_t id;
+	struct hashtab_node hnode;
+};
+
+static int conn_match(const struct hashtab_node *node, const void *key)
+{
+	return hashtab_entry(node, struct conn, hnode)->id == *(const uint64_t *) key;
+}
+
+hashtab_t *ht = hashtab_create(1024, 64);
+
+hashtab_insert(ht, &c->hnode, hashtab_hash_u64(c->id), &c->id, conn_match);
+node = hashtab_lookup(ht, hashtab_hash_u64(id), &id, conn_match);
+hashtab_remove(ht, &c->hnode);
+ * \endcode
+ */
+
+#ifndef HASHTAB_H_
+#define HASHTAB_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "list/list.h"
+#include "hash/hash.h"
+#include "atomic/atomic.h"
+
+#define HASHTAB_CACHELINE (64)
+#define HASHTAB_REHASH_STEP (4) //!< Old buckets moved per insert/remove while rehashing.
+
+/*!
+ * \brief Embed this in objects to hash.
+ */
+struct hashtab_node
+{
+	struct hlist_node hlist;
+	uint32_t hash; //!< Set by hashtab_insert(). Read only for the user.
+};
+
+#define hashtab_entry(ptr, type, member) container_of(ptr, type, member)
+
+/*!
+ * \brief Compare the key of node with key. Return non-zero if equal.
+ *
+ * Called with the bucket lock held. Do not call the table from it.
+ */
+typedef int (*hashtab_match_t)(const struct hashtab_node *node, const void *key);
+
+struct hashtab_lock
+{
+	pthread_mutex_t lock;
+} __attribute__((aligned(HASHTAB_CACHELINE)));
+
+/*!
+ * \brief Hash table structure.
+ */
+typedef struct hashtab
+{
+	struct hlist_head *tbl[2]; //!< [0] main buckets, [1] buckets being filled by a rehash
+	unsigned int mask[2]; //!< Bucket count - 1 of tbl[0], tbl[1]
+	unsigned int rehash_idx; //!< Buckets of tbl[0] below this are moved to tbl[1].
+
+	struct hashtab_lock *locks; //!< Stripe locks
+	unsigned int lock_mask; //!< Stripe count - 1
+
+	atomic64_t count; //!< Number of nodes
+	pthread_mutex_t resize_lock; //!< One resize at a time
+} hashtab_t;
+
+extern int hashtab_init(hashtab_t *ht, unsigned int size, unsigned int nr_locks);
+extern void hashtab_exit(hashtab_t *ht);
+extern hashtab_t *hashtab_create(unsigned int size, unsigned int nr_locks);
+extern void hashtab_destroy(hashtab_t *ht);
+
+extern struct hashtab_node *hashtab_insert(hashtab_t *ht, struct hashtab_node *node, const uint32_t hash, const void *key, hashtab_match_t match);
+extern struct hashtab_node *hashtab_lookup(hashtab_t *ht, const uint32_t hash, const void *key, hashtab_match_t match);
+extern void hashtab_remove(hashtab_t *ht, struct hashtab_node *node);
+extern void hashtab_flush(hashtab_t *ht, void (*free_fn)(struct hashtab_node *node, void *arg), void *arg);
+extern void hashtab_rehash(hashtab_t *ht);
+
+#define hashtab_count(ht) atomic64_read(&(ht)->count)
+
+/*!
+ * \brief Hash of a 64-bit key. (murmur3 finalizer)
+ */
+static inline uint32_t hashtab_hash_u64(uint64_t k)
+{
+	return (uint32_t) hash_mix64(k);
+}
+
+/*!
+ * \brief Hash of a byte string. (FNV-1a)
+ */
+static inline uint32_t hashtab_hash_mem(const void *data, unsigned int len)
+{
+	const uint8_t *p = data;
+	uint32_t h = 2166136261U;
+
+	while (len--)
+	{
+		h ^= *p++;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+#endif /* HASHTAB_H_ */
@@ -0,0 +1,300 @@
+/*
+ * Queue throughput benchmark: mpmcq and mpscq vs a mutex-protected list.
+ *
+ * Usage: lfqueue_bench [items [max_threads | producers consumers]]
+ *
+ * ITEMS jobs are passed from producer to consumer threads. For n = 1, 2, 4, ...
+ * up to MAX_THREADS, each queue runs with n producers and n consumers, and,
+ * as worker pools do, n producers feeding 1 consumer and 1 producer feeding
+ * n consumers. mpscq only runs with 1 consumer. Given producers and consumers,
+ * only that point is run.
+ * "mutex_list" is the pattern it replaces: list_head-linked jobs on a list
+ * guarded by a pthread mutex. Every job is checked to arrive exactly once,
+ * and in order per producer where the queue promises it.
+ */
+
+#include "list/list.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "bench.h"
+#include "atomic/atomic.h"
+#include "mpmcq.h"
+#include "mpscq.h"
+
+#define ITEMS       (1 << 20)
+#define MAX_THREADS 64
+#define MPMCQ_SIZE  1024
+#define SPIN_MAX    64 //!< Retries on a full or empty queue before yielding the cpu
+
+enum { Q_MPMC, Q_MPSC, Q_MUTEX, Q_MAX };
+
+static const char *q_name[Q_MAX] = { "mpmcq", "mpscq", "mutex_list" };
+
+struct bench_job
+{
+	struct list_head list;
+	struct mpscq_node qnode;
+	unsigned int producer;
+	unsigned long seq; //!< Position in its producer's sequence
+};
+
+struct bench_mutex_list
+{
+	pthread_mutex_t lock;
+	struct list_head head;
+};
+
+static struct bench_job *jobs;
+static unsigned long nr_items;
+
+static int q_type;
+static unsigned int nr_prod, nr_cons;
+static mpmcq_t *mpmc;
+static mpscq_t mpsc;
+static struct bench_mutex_list mlist;
+
+static pthread_barrier_t start;
+static atomic64_t consumed;
+static atomic64_t errors;
+static atomic_t *seen; //!< Per job: 0 until consumed once
+
+static inline void bench_backoff(unsigned int *spin)
+{
+	if (++(*spin) < SPIN_MAX)
+	{
+		__asm__ __volatile__ ("" : : : "memory");
+	}
+	else
+	{
+		*spin = 0;
+		sched_yield();
+	}
+}
+
+static void *producer(void *arg)
+{
+	unsigned int id = (uintptr_t) arg, spin = 0;
+	unsigned long i;
+	struct bench_job *job;
+
+	pthread_barrier_wait(&start);
+
+	/* Producer id owns jobs id, id + nr_prod, ... */
+	for (i = id; i < nr_items; i += nr_prod)
+	{
+		job = jobs + i;
+
+		switch (q_type)
+		{
+		case Q_MPMC:
+			while (mpmcq_enqueue(mpmc, job) < 0)
+				bench_backoff(&spin);
+			break;
+		case Q_MPSC:
+			mpscq_push(&mpsc, &job->qnode);
+			break;
+		default:
+			pthread_mutex_lock(&mlist.lock);
+			list_add_tail(&job->list, &mlist.head);
+			pthread_mutex_unlock(&mlist.lock);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static struct bench_job *consume_one(void)
+{
+	struct mpscq_node *node;
+	struct bench_job *job = NULL;
+
+	switch (q_type)
+	{
+	case Q_MPMC:
+		if (mpmcq_dequeue(mpmc, (void **) &job) < 0)
+			job = NULL;
+		break;
+	case Q_MPSC:
+		node = mpscq_pop(&mpsc);
+		job = node ? mpscq_entry(node, struct bench_job, qnode) : NULL;
+		break;
+	default:
+		pthread_mutex_lock(&mlist.lock);
+		if (!list_empty(&mlist.head))
+		{
+			job = list_entry(mlist.head.next, struct bench_job, list);
+			list_del(&job->list);
+		}
+		pthread_mutex_unlock(&mlist.lock);
+		break;
+	}
+
+	return job;
+}
+
+static void *consumer(void *arg)
+{
+	unsigned long last[MAX_THREADS];
+	long err = 0;
+	unsigned int spin = 0, i;
+	struct bench_job *job;
+
+	(void) arg;
+
+	for (i = 0; i < MAX_THREADS; i++)
+		last[i] = 0;
+
+	pthread_barrier_wait(&start);
+
+	while ((unsigned long) atomic64_read(&consumed) < nr_items)
+	{
+		job = consume_one();
+		if (job == NULL)
+		{
+			bench_backoff(&spin);
+			continue;
+		}
+
+		spin = 0;
+		err += (atomic_xchg_relaxed(&seen[job - jobs], 1) != 0);
+
+		/* Every queue here is FIFO per producer; only one consumer can observe it. */
+		if (nr_cons == 1)
+		{
+			err += (job->seq != last[job->producer]);
+			last[job->producer] = job->seq + 1;
+		}
+
+		(void) atomic64_add_return_relaxed(1, &consumed);
+	}
+
+	(void) atomic64_add_return_relaxed(err, &errors);
+	return NULL;
+}
+
+static int run(const int type, const unsigned int prod, const unsigned int cons)
+{
+	pthread_t th[2 * MAX_THREADS];
+	unsigned int i, n = 0;
+	unsigned long j;
+	uint64_t t;
+
+	q_type = type;
+	nr_prod = prod;
+	nr_cons = cons;
+	atomic64_set(&consumed, 0);
+
+	for (j = 0; j < nr_items; j++)
+	{
+		jobs[j].producer = j % prod;
+		jobs[j].seq = j / prod;
+		atomic_set(&seen[j], 0);
+	}
+
+	pthread_barrier_init(&start, NULL, prod + cons + 1);
+
+	for (i = 0; i < prod; i++)
+		if (pthread_create(&th[n], NULL, producer, (void *) (uintptr_t) i) == 0)
+			n++;
+	for (i = 0; i < cons; i++)
+		if (pthread_create(&th[n], NULL, consumer, NULL) == 0)
+			n++;
+
+	if (n != prod + cons)
+	{
+		fprintf(stderr, "Cannot create threads\n");
+		exit(1);
+	}
+
+	pthread_barrier_wait(&start);
+	t = bench_now_ns();
+
+	for (i = 0; i < n; i++)
+		pthread_join(th[i], NULL);
+
+	t = bench_now_ns() - t;
+	pthread_barrier_destroy(&start);
+
+	printf("%s,%u,%u,%lu,%.2f\n", q_name[type], prod, cons, nr_items, (double) nr_items * 1000.0 / t);
+
+	for (j = 0; j < nr_items; j++)
+	{
+		if (atomic_read(&seen[j]) != 1)
+			(void) atomic64_add_return_relaxed(1, &errors);
+	}
+
+	return 0;
+}
+
+static void run_all(const unsigned int prod, const unsigned int cons)
+{
+	run(Q_MPMC, prod, cons);
+	if (cons == 1)
+	{
+		run(Q_MPSC, prod, cons);
+	}
+	run(Q_MUTEX, prod, cons);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int max_threads, cons, n;
+
+	nr_items = bench_arg(argc, argv, 1, ITEMS);
+	max_threads = bench_arg(argc, argv, 2, MAX_THREADS);
+	cons = bench_arg(argc, argv, 3, 0);
+	if (nr_items == 0 || max_threads == 0 || max_threads > MAX_THREADS || cons > MAX_THREADS || (argc > 3 && cons == 0))
+	{
+		return bench_usage(argv[0], "[items [max_threads | producers consumers]] (threads 1 to " BENCH_STR(MAX_THREADS) ")");
+	}
+
+	jobs = calloc(nr_items, sizeof(*jobs));
+	seen = calloc(nr_items, sizeof(*seen));
+	mpmc = mpmcq_create(MPMCQ_SIZE);
+	if (jobs == NULL || seen == NULL || mpmc == NULL)
+	{
+		return 1;
+	}
+
+	mpscq_init(&mpsc);
+	pthread_mutex_init(&mlist.lock, NULL);
+	INIT_LIST_HEAD(&mlist.head);
+
+	printf("queue,producers,consumers,items,mops_per_sec\n");
+
+	if (cons)
+	{
+		run_all(max_threads, cons);
+	}
+	else
+	{
+		for (n = 1; n <= max_threads; n *= 2)
+		{
+			run_all(n, n);
+			if (n > 1)
+			{
+				run_all(n, 1);
+				run_all(1, n);
+			}
+		}
+	}
+
+	mpmcq_destroy(mpmc);
+	pthread_mutex_destroy(&mlist.lock);
+	free(seen);
+	free(jobs);
+
+	if (atomic64_read(&errors))
+	{
+		fprintf(stderr, "BUG: %ld jobs lost, duplicated or out of order\n", (long) atomic64_read(&errors));
+		return 1;
+	}
+
+	return 0;
+}
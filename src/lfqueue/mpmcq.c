@@ -0,0 +1,202 @@
+/*!
+ * \file mpmcq.c
+ * \brief Bounded lock-free multi producer/multi consumer queue of pointers.
+ *
+ * \sa mpmcq.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mpmcq.h"
+
+static inline unsigned int pow2_adjust(unsigned int x)
+{
+	x--;
+	x |= x >> 1;
+	x |= x >> 2;
+	x |= x >> 4;
+	x |= x >> 8;
+	x |= x >> 16;
+
+	return (x + 1);
+}
+
+/*!
+ * \brief Init a queue.
+ * \param q The queue to init
+ * \param size Cell count. Round up to a power of 2, at least 2.
+ * \return 0 if ok
+ * \return < 0 if error
+ */
+extern int mpmcq_init(mpmcq_t *q, const unsigned int size)
+{
+	size_t i, n;
+
+	assert(q != NULL);
+
+	if (size == 0 || size > (1U << 31))
+	{
+		return -1;
+	}
+
+	n = size < 2 ? 2 : pow2_adjust(size);
+
+	memset(q, 0x00, sizeof(*q));
+	if (posix_memalign((void **) &q->cells, MPMCQ_CACHELINE, n * sizeof(struct mpmcq_cell)))
+	{
+		q->cells = NULL;
+		return -1;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		q->cells[i].seq = i;
+		q->cells[i].data = NULL;
+	}
+
+	q->mask = n - 1;
+	return 0;
+}
+
+/*!
+ * \brief Release queue storage. Pointers still queued are dropped.
+ * \sa mpmcq_init
+ */
+extern void mpmcq_exit(mpmcq_t *q)
+{
+	if (q == NULL) return;
+
+	free(q->cells);
+	q->cells = NULL;
+}
+
+/*!
+ * \brief Create a new queue and initialize it.
+ * \param size Cell count. Round up to a power of 2.
+ * \return A pointer to created queue
+ * \return NULL if error
+ */
+extern mpmcq_t *mpmcq_create(const unsigned int size)
+{
+	mpmcq_t *q;
+
+	if (posix_memalign((void **) &q, MPMCQ_CACHELINE, sizeof(*q)))
+	{
+		return NULL;
+	}
+
+	if (mpmcq_init(q, size) < 0)
+	{
+		free(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+/*!
+ * \brief Destroy a queue
+ * \sa mpmcq_create
+ */
+extern void mpmcq_destroy(mpmcq_t *q)
+{
+	if (q == NULL) return;
+
+	mpmcq_exit(q);
+	free(q);
+}
+
+/*!
+ * \brief Add a pointer. (any thread)
+ * \return 0 if ok
+ * \return -1 if full
+ */
+extern int mpmcq_enqueue(mpmcq_t *q, void *data)
+{
+	struct mpmcq_cell *cell;
+	int64_t pos = atomic64_read(&q->enqueue_pos), diff;
+
+	for (;;)
+	{
+		cell = &q->cells[pos & q->mask];
+		diff = smp_load_acquire(&cell->seq) - pos;
+
+		if (diff == 0)
+		{
+			/* The cell is free for pos. Claim pos; on failure pos is reloaded. */
+			if (atomic64_try_cmpxchg_relaxed(&q->enqueue_pos, &pos, pos + 1))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			/* The cell still holds the pointer of one lap ago. */
+			return -1;
+		}
+		else
+		{
+			pos = atomic64_read(&q->enqueue_pos);
+		}
+	}
+
+	cell->data = data;
+	smp_store_release(&cell->seq, pos + 1);
+
+	return 0;
+}
+
+/*!
+ * \brief Take the oldest pointer. (any thread)
+ * \return 0 if ok
+ * \return -1 if empty
+ */
+extern int mpmcq_dequeue(mpmcq_t *q, void **data)
+{
+	struct mpmcq_cell *cell;
+	int64_t pos = atomic64_read(&q->dequeue_pos), diff;
+
+	for (;;)
+	{
+		cell = &q->cells[pos & q->mask];
+		diff = smp_load_acquire(&cell->seq) - (pos + 1);
+
+		if (diff == 0)
+		{
+			if (atomic64_try_cmpxchg_relaxed(&q->dequeue_pos, &pos, pos + 1))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			/* Not filled yet for this lap. */
+			return -1;
+		}
+		else
+		{
+			pos = atomic64_read(&q->dequeue_pos);
+		}
+	}
+
+	*data = cell->data;
+
+	/* Hand the cell to the producer of the next lap. */
+	smp_store_release(&cell->seq, pos + (int64_t) q->mask + 1);
+
+	return 0;
+}
+
+/*!
+ * \brief Get queued pointer count. (A hint if other threads are running)
+ */
+extern size_t mpmcq_get_used(mpmcq_t *q)
+{
+	int64_t head = atomic64_read(&q->dequeue_pos);
+	int64_t tail = atomic64_read(&q->enqueue_pos);
+
+	return tail > head ? (size_t) (tail - head) : 0;
+}
@@ -0,0 +1,66 @@
+/*!
+ * \file mpmcq.h
+ * \brief Bounded lock-free multi producer/multi consumer queue of pointers.
+ *
+ * \details
+ * Dmitry Vyukov's bounded MPMC queue. Each cell carries a sequence number
+ * which tells whose turn it is: a producer at position pos may fill the cell
+ * when seq == pos, a consumer may empty it when seq == pos + 1. A thread
+ * claims a position by one CAS on the shared enqueue (or dequeue) position,
+ * then works on its own cell. No thread ever waits for another to publish:
+ * the queue just looks full or empty until it does.
+ *
+ * Pass anything by pointer, e.g. a job with a list_head inside.
+ *
+ * \par Example:
+ * \code
+mpmcq_t *q = mpmcq_create(1024);
+
+// producer threads
+while (mpmcq_enqueue(q, job) < 0)
+	sched_yield();  // full
+
+// consumer threads
+if (mpmcq_dequeue(q, (void **) &job) == 0)
+	run(job);
+ * \endcode
+ */
+
+#ifndef MPMCQ_H_
+#define MPMCQ_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "atomic/atomic.h"
+
+#define MPMCQ_CACHELINE (64)
+
+struct mpmcq_cell
+{
+	int64_t seq;
+	void *data;
+};
+
+/*!
+ * \brief MPMC queue structure.
+ */
+typedef struct mpmcq
+{
+	struct mpmcq_cell *cells;
+	size_t mask; //!< Cell count - 1. Cell count is a power of 2.
+
+	atomic64_t enqueue_pos __attribute__((aligned(MPMCQ_CACHELINE))); //!< Written by producers.
+	atomic64_t dequeue_pos __attribute__((aligned(MPMCQ_CACHELINE))); //!< Written by consumers.
+} __attribute__((aligned(MPMCQ_CACHELINE))) mpmcq_t;
+
+extern int mpmcq_init(mpmcq_t *q, const unsigned int size);
+extern void mpmcq_exit(mpmcq_t *q);
+extern mpmcq_t *mpmcq_create(const unsigned int size);
+extern void mpmcq_destroy(mpmcq_t *q);
+
+extern int mpmcq_enqueue(mpmcq_t *q, void *data);
+extern int mpmcq_dequeue(mpmcq_t *q, void **data);
+extern size_t mpmcq_get_used(mpmcq_t *q);
+
+#endif /* MPMCQ_H_ */
@@ -0,0 +1,103 @@
+/*!
+ * \file mpscq.c
+ * \brief Unbounded intrusive lock-free multi producer/single consumer queue.
+ *
+ * \details
+ * Nodes are linked from tail (oldest) to head (newest). The stub node is
+ * pushed back whenever the consumer would otherwise take the last node, so
+ * head never becomes NULL and producers never touch the tail.
+ *
+ * \sa mpscq.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "mpscq.h"
+
+/*!
+ * \brief Init an empty queue.
+ */
+extern void mpscq_init(mpscq_t *q)
+{
+	assert(q != NULL);
+
+	q->stub.next = NULL;
+	atomic_ptr_set(&q->head, &q->stub);
+	q->tail = &q->stub;
+}
+
+/*!
+ * \brief Add a node. (any thread) Never fails, never waits.
+ */
+extern void mpscq_push(mpscq_t *q, struct mpscq_node *node)
+{
+	struct mpscq_node *prev;
+
+	WRITE_ONCE(node->next, NULL);
+
+	/* Serialize producers: each gets the node before its own. */
+	prev = atomic_ptr_xchg(&q->head, node);
+
+	/* Until this store, the consumer sees the queue end at prev. */
+	smp_store_release(&prev->next, node);
+}
+
+/*!
+ * \brief Take the oldest node. (the consumer thread only)
+ * \return the node
+ * \return NULL if empty, or if a producer is half way through a push
+ */
+extern struct mpscq_node *mpscq_pop(mpscq_t *q)
+{
+	struct mpscq_node *tail = q->tail, *next = smp_load_acquire(&tail->next), *head;
+
+	if (tail == &q->stub)
+	{
+		if (next == NULL)
+		{
+			return NULL;
+		}
+
+		/* Skip the stub. */
+		q->tail = next;
+		tail = next;
+		next = smp_load_acquire(&next->next);
+	}
+
+	if (next)
+	{
+		q->tail = next;
+		return tail;
+	}
+
+	/* tail looks last. If head moved on, a push is half way: retry later. */
+	head = atomic_ptr_read_acquire(&q->head);
+	if (tail != head)
+	{
+		return NULL;
+	}
+
+	/* tail is really last. Put the stub behind it so tail can be taken. */
+	mpscq_push(q, &q->stub);
+
+	next = smp_load_acquire(&tail->next);
+	if (next)
+	{
+		q->tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Return non-zero if nothing is queued. (the consumer thread only)
+ */
+extern int mpscq_empty(mpscq_t *q)
+{
+	struct mpscq_node *tail = q->tail;
+
+	return tail == &q->stub && smp_load_acquire(&tail->next) == NULL;
+}
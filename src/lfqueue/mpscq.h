@@ -0,0 +1,65 @@
+/*!
+ * \file mpscq.h
+ * \brief Unbounded intrusive lock-free multi producer/single consumer queue.
+ *
+ * \details
+ * Dmitry Vyukov's intrusive MPSC queue. Objects embed a struct mpscq_node,
+ * like a list_head, so a push never allocates. A producer pushes by one
+ * atomic exchange on the head and then links the previous head to its node;
+ * it never loops nor waits. The consumer follows the links from the tail.
+ *
+ * Between those two producer steps the queue is briefly cut: mpscq_pop() then
+ * returns NULL although nodes follow, and the consumer simply tries again
+ * later, as for an empty queue.
+ *
+ * \par Example:
+ * \code
+struct job
+{
+	struct mpscq_node qnode;
+	...
+};
+
+mpscq_t q;
+mpscq_init(&q);
+
+// producer threads
+mpscq_push(&q, &job->qnode);
+
+// the consumer thread
+while ((node = mpscq_pop(&q)) != NULL)
+	run(mpscq_entry(node, struct job, qnode));
+ * \endcode
+ */
+
+#ifndef MPSCQ_H_
+#define MPSCQ_H_
+
+#include "list/list.h"
+#include "atomic/atomic.h"
+
+#define MPSCQ_CACHELINE (64)
+
+struct mpscq_node
+{
+	struct mpscq_node *next;
+};
+
+#define mpscq_entry(ptr, type, member) container_of(ptr, type, member)
+
+/*!
+ * \brief MPSC queue structure.
+ */
+typedef struct mpscq
+{
+	atomic_ptr_t head __attribute__((aligned(MPSCQ_CACHELINE))); //!< Last pushed node. Written by producers.
+	struct mpscq_node *tail __attribute__((aligned(MPSCQ_CACHELINE))); //!< Next to pop. Consumer only.
+	struct mpscq_node stub; //!< Keeps the list non-empty
+} mpscq_t;
+
+extern void mpscq_init(mpscq_t *q);
+extern void mpscq_push(mpscq_t *q, struct mpscq_node *node);
+extern struct mpscq_node *mpscq_pop(mpscq_t *q);
+extern int mpscq_empty(mpscq_t *q);
+
+#endif /* MPSCQ_H_ */
@@ -15,6 +15,165 @@ struct mempool_slice
 	uint8_t buf[0];
 };
 
+#if HAVE_MEMPOOL_GUARD
+/*
+ * Guard mode slice layout. The slice header is never handed to the caller,
+ * so that list and magic survive while the object is poisoned.
+ *
+ * +-----+----------+-----------------+----------+
+ * | hdr | red zone | object (mp->sz) | red zone |
+ * +-----+----------+-----------------+----------+
+ *                  ^
+ *                  |
+ *                  pointer returned by mempool_alloc()
+ */
+#define MEMPOOL_SLICE_MAGIC_INUSE (54085409)
+
+#define MEMPOOL_GUARD_RZ_SIZE (16)
+#define MEMPOOL_GUARD_RZ_BYTE (0xbb)
+#define MEMPOOL_GUARD_POISON_FREE (0x6b)
+#define MEMPOOL_GUARD_POISON_INUSE (0x5a)
+
+#define slice_to_obj(_slice) ((void *) ((_slice)->buf + MEMPOOL_GUARD_RZ_SIZE))
+#define obj_to_slice(_p) \
+	((struct mempool_slice *) (((uint8_t *) (_p)) - MEMPOOL_GUARD_RZ_SIZE - offsetof(struct mempool_slice, buf)))
+#define slice_alloc_size(_mp) (sizeof(struct mempool_slice) + (MEMPOOL_GUARD_RZ_SIZE * 2) + (_mp)->sz)
+
+#define slice_rz_head(_slice) ((_slice)->buf)
+#define slice_rz_tail(_mp, _slice) ((_slice)->buf + MEMPOOL_GUARD_RZ_SIZE + (_mp)->sz)
+
+static void mempool_guard_report(struct mempool *mp, struct mempool_slice *slice, const char *what, const int offset)
+{
+	fprintf(stderr, " * ERROR: Detect %s at %s slice %p (offset %d)\n", what, mp->name, slice_to_obj(slice), offset);
+	BUG();
+}
+
+/*!
+ * @return Offset of the first byte not equal to pattern, or -1 if all match.
+ */
+static int mempool_guard_scan(const uint8_t *p, const unsigned int len, const uint8_t pattern)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+	{
+		if (p[i] != pattern)
+		{
+			return (int) i;
+		}
+	}
+
+	return -1;
+}
+
+static void mempool_guard_check_rz(struct mempool *mp, struct mempool_slice *slice)
+{
+	int offset;
+
+	offset = mempool_guard_scan(slice_rz_head(slice), MEMPOOL_GUARD_RZ_SIZE, MEMPOOL_GUARD_RZ_BYTE);
+	if (offset >= 0)
+	{
+		mempool_guard_report(mp, slice, "underflow", offset - MEMPOOL_GUARD_RZ_SIZE);
+	}
+
+	offset = mempool_guard_scan(slice_rz_tail(mp, slice), MEMPOOL_GUARD_RZ_SIZE, MEMPOOL_GUARD_RZ_BYTE);
+	if (offset >= 0)
+	{
+		mempool_guard_report(mp, slice, "overflow", (int) mp->sz + offset);
+	}
+}
+
+/*!
+ * @brief Prepare a slice fresh from malloc.
+ */
+static void mempool_guard_init(struct mempool *mp, struct mempool_slice *slice)
+{
+	memset(slice_rz_head(slice), MEMPOOL_GUARD_RZ_BYTE, MEMPOOL_GUARD_RZ_SIZE);
+	memset(slice_rz_tail(mp, slice), MEMPOOL_GUARD_RZ_BYTE, MEMPOOL_GUARD_RZ_SIZE);
+	memset(slice_to_obj(slice), MEMPOOL_GUARD_POISON_INUSE, mp->sz);
+
+	slice->magic = MEMPOOL_SLICE_MAGIC_INUSE;
+}
+
+/*!
+ * @brief Verify a cached slice before handing it out again.
+ */
+static void mempool_guard_get(struct mempool *mp, struct mempool_slice *slice)
+{
+	int offset;
+
+	mempool_guard_check_rz(mp, slice);
+
+	offset = mempool_guard_scan(slice_to_obj(slice), mp->sz, MEMPOOL_GUARD_POISON_FREE);
+	if (offset >= 0)
+	{
+		mempool_guard_report(mp, slice, "write after free", offset);
+	}
+
+	memset(slice_to_obj(slice), MEMPOOL_GUARD_POISON_INUSE, mp->sz);
+	slice->magic = MEMPOOL_SLICE_MAGIC_INUSE;
+}
+
+/*!
+ * @brief Verify and poison a slice given back by the caller.
+ */
+static void mempool_guard_put(struct mempool *mp, struct mempool_slice *slice)
+{
+	if (slice->magic != MEMPOOL_SLICE_MAGIC_INUSE)
+	{
+		mempool_guard_report(mp, slice, (slice->magic == MEMPOOL_SLICE_MAGIC) ? "double free" : "invalid free", 0);
+	}
+
+	mempool_guard_check_rz(mp, slice);
+
+	memset(slice_to_obj(slice), MEMPOOL_GUARD_POISON_FREE, mp->sz);
+	slice->magic = MEMPOOL_SLICE_MAGIC;
+}
+
+#define mempool_nr_quarantine(_mp) ((_mp)->nr_quarantine)
+#else
+#define slice_to_obj(_slice) ((void *) (_slice))
+#define obj_to_slice(_p) ((struct mempool_slice *) (_p))
+#define slice_alloc_size(_mp) ((_mp)->sz)
+
+#define mempool_nr_quarantine(_mp) (0)
+#endif
+
+/*
+ * Slices owned by callers.
+ */
+#define mempool_inuse(_mp) ((_mp)->ref - (_mp)->nr_free - mempool_nr_quarantine(_mp))
+
+/*
+ * Every pool created by mempool_init() is linked here until mempool_exit().
+ */
+static LIST_HEAD(mempool_registry);
+static pthread_mutex_t mempool_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * TLS pools initialized by this thread. Exited by the key destructor at thread exit.
+ */
+static __thread struct mempool *mempool_tls_list = NULL;
+
+static pthread_key_t mempool_tls_key;
+static pthread_once_t mempool_tls_once = PTHREAD_ONCE_INIT;
+
+static void mempool_tls_destroy(void *p)
+{
+	(void) p;
+
+	/* mempool_exit() unlinks the pool. */
+	while (mempool_tls_list)
+	{
+		mempool_exit(mempool_tls_list);
+	}
+}
+
+static void mempool_tls_key_init(void)
+{
+	(void) pthread_key_create(&mempool_tls_key, mempool_tls_destroy);
+}
+
 static struct mempool_slice *alloc_slice(struct mempool *mp)
 {
 	struct mempool_slice *slice;
@@ -31,13 +190,18 @@ static struct mempool_slice *alloc_slice(struct mempool *mp)
 		}
 
 		BUG_ON(mp->sz < sizeof(struct mempool_slice));
-		slice = malloc(mp->sz);
+		slice = malloc(slice_alloc_size(mp));
 		if (!slice)
 		{
 			return NULL;
 		}
 
+#if HAVE_MEMPOOL_GUARD
+		mempool_guard_init(mp, slice);
+#endif
+
 		mp->ref++;
+		mp->miss++;
 	}
 	else
 	{
@@ -48,11 +212,53 @@ static struct mempool_slice *alloc_slice(struct mempool *mp)
 		list_del(&slice->list);
 
 		BUG_ON(slice->magic != MEMPOOL_SLICE_MAGIC);
+
+#if HAVE_MEMPOOL_GUARD
+		mempool_guard_get(mp, slice);
+#endif
+
+		mp->nr_free--;
+		mp->hit++;
+	}
+
+	mp->nr_alloc++;
+	if (mempool_inuse(mp) > mp->interval_peak)
+	{
+		mp->interval_peak = mempool_inuse(mp);
+		if (mp->interval_peak > mp->peak)
+		{
+			mp->peak = mp->interval_peak;
+		}
 	}
 
 	return slice;
 }
 
+/*!
+ * @brief Put a slice back to free list. (Or quarantine in guard mode.)
+ * @note Call with pool lock held.
+ */
+static inline void put_slice(struct mempool *mp, struct mempool_slice *slice)
+{
+#if HAVE_MEMPOOL_GUARD && MEMPOOL_GUARD_QUARANTINE_MAX
+	list_add_tail(&slice->list, &mp->list_quarantine);
+	mp->nr_quarantine++;
+
+	if (mp->nr_quarantine <= MEMPOOL_GUARD_QUARANTINE_MAX)
+	{
+		return;
+	}
+
+	/* Release the oldest one for reuse. */
+	slice = list_first_entry(&mp->list_quarantine, struct mempool_slice, list);
+	list_del(&slice->list);
+	mp->nr_quarantine--;
+#endif
+
+	list_add(&slice->list, &mp->list_free);
+	mp->nr_free++;
+}
+
 static void free_slice(struct mempool *mp, struct mempool_slice *slice)
 {
 	BUG_ON(slice->magic != MEMPOOL_SLICE_MAGIC);
@@ -71,34 +277,219 @@ void *mempool_alloc(struct mempool *mp)
 	}
 	pthread_spin_unlock(&mp->lock);
 
+	if (slice == NULL)
+	{
+		return NULL;
+	}
+
 	if (mp->ctor)
 	{
-		if (mp->ctor((void *) slice))
+		if (mp->ctor(slice_to_obj(slice)))
 		{
 			/*
 			 * Caller reject this allocation.
 			 */
-			mempool_free(mp, slice);
+			mempool_free(mp, slice_to_obj(slice));
 			return NULL;
 		}
 	}
 
-	return slice;
+	return slice_to_obj(slice);
 }
 
 void mempool_free(struct mempool *mp, void *p)
 {
-	struct mempool_slice *slice = (struct mempool_slice *) p;
+	struct mempool_slice *slice = obj_to_slice(p);
 
 	if (mp->dtor)
 	{
 		mp->dtor(p);
 	}
 
+#if HAVE_MEMPOOL_GUARD
+	mempool_guard_put(mp, slice);
+#else
 	slice->magic = MEMPOOL_SLICE_MAGIC;
+#endif
 
 	pthread_spin_lock(&mp->lock);
-	list_add(&slice->list, &mp->list_free);
+	put_slice(mp, slice);
+	mp->nr_free_call++;
+	pthread_spin_unlock(&mp->lock);
+}
+
+/*!
+ * @brief Alloc n slices with one lock round trip.
+ *
+ * @details Cached slices are cut from the free list head as one chain. The rest
+ * are reserved against max under the same lock and malloc-ed after unlock.
+ * Slices rejected by ctor are returned to the pool and not stored in objs.
+ *
+ * @return Number of slices stored at the beginning of objs. (<= n)
+ */
+unsigned int mempool_alloc_bulk(struct mempool *mp, void **objs, const unsigned int n)
+{
+	struct mempool_slice *slice;
+	struct list_head list_bulk, *entry;
+	unsigned int i, hit, miss, cnt = 0;
+
+	if (n == 0)
+	{
+		return 0;
+	}
+
+	INIT_LIST_HEAD(&list_bulk);
+
+	pthread_spin_lock(&mp->lock);
+	{
+		hit = (mp->nr_free < n) ? mp->nr_free : n;
+		miss = n - hit;
+
+		if (hit)
+		{
+			entry = &mp->list_free;
+			for (i = 0; i < hit; i++)
+			{
+				entry = entry->next;
+			}
+
+			list_cut_position(&list_bulk, &mp->list_free, entry);
+			mp->nr_free -= hit;
+		}
+
+		/* Reserve new slices, but do not exceed limit. */
+		if (mp->max && mp->ref + miss > mp->max)
+		{
+			mp->fail++;
+			miss = (mp->ref < mp->max) ? (mp->max - mp->ref) : 0;
+		}
+
+		mp->ref += miss;
+		mp->hit += hit;
+		mp->miss += miss;
+		mp->nr_alloc += hit + miss;
+
+		if (mempool_inuse(mp) > mp->interval_peak)
+		{
+			mp->interval_peak = mempool_inuse(mp);
+			if (mp->interval_peak > mp->peak)
+			{
+				mp->peak = mp->interval_peak;
+			}
+		}
+	}
+	pthread_spin_unlock(&mp->lock);
+
+	list_for_each_entry(slice, &list_bulk, list)
+	{
+		BUG_ON(slice->magic != MEMPOOL_SLICE_MAGIC);
+#if HAVE_MEMPOOL_GUARD
+		mempool_guard_get(mp, slice);
+#endif
+		objs[cnt++] = slice_to_obj(slice);
+	}
+
+	BUG_ON(mp->sz < sizeof(struct mempool_slice));
+	for (i = 0; i < miss; i++)
+	{
+		slice = malloc(slice_alloc_size(mp));
+		if (!slice)
+		{
+			break;
+		}
+
+#if HAVE_MEMPOOL_GUARD
+		mempool_guard_init(mp, slice);
+#endif
+		objs[cnt++] = slice_to_obj(slice);
+	}
+
+	if (i < miss)
+	{
+		/* Give back the unused reservation. */
+		pthread_spin_lock(&mp->lock);
+		mp->ref -= (miss - i);
+		mp->fail++;
+		pthread_spin_unlock(&mp->lock);
+	}
+
+	if (mp->ctor)
+	{
+		unsigned int ok = 0;
+
+		for (i = 0; i < cnt; i++)
+		{
+			if (mp->ctor(objs[i]))
+			{
+				/*
+				 * Caller reject this allocation.
+				 */
+				mempool_free(mp, objs[i]);
+				continue;
+			}
+
+			objs[ok++] = objs[i];
+		}
+
+		cnt = ok;
+	}
+
+	return cnt;
+}
+
+/*!
+ * @brief Free n slices with one lock round trip.
+ *
+ * @details The slices are chained without lock, then spliced onto the free list
+ * head as a whole.
+ */
+void mempool_free_bulk(struct mempool *mp, void **objs, const unsigned int n)
+{
+	struct mempool_slice *slice;
+	struct list_head list_bulk;
+	unsigned int i;
+
+	if (n == 0)
+	{
+		return;
+	}
+
+	INIT_LIST_HEAD(&list_bulk);
+
+	for (i = 0; i < n; i++)
+	{
+		slice = obj_to_slice(objs[i]);
+
+		if (mp->dtor)
+		{
+			mp->dtor(objs[i]);
+		}
+
+#if HAVE_MEMPOOL_GUARD
+		mempool_guard_put(mp, slice);
+#else
+		slice->magic = MEMPOOL_SLICE_MAGIC;
+#endif
+		list_add_tail(&slice->list, &list_bulk);
+	}
+
+	pthread_spin_lock(&mp->lock);
+#if HAVE_MEMPOOL_GUARD
+	{
+		struct mempool_slice *slice_save;
+
+		/* Keep quarantine order. Performance does not matter here. */
+		list_for_each_entry_safe(slice, slice_save, &list_bulk, list)
+		{
+			list_del(&slice->list);
+			put_slice(mp, slice);
+		}
+	}
+#else
+	list_splice(&list_bulk, &mp->list_free);
+	mp->nr_free += n;
+#endif
+	mp->nr_free_call += n;
 	pthread_spin_unlock(&mp->lock);
 }
 
@@ -115,6 +506,7 @@ static inline void __mempool_recycle(struct mempool *mp, const unsigned int rese
 			}
 
 			list_del(&slice->list);
+			mp->nr_free--;
 			free_slice(mp, slice);
 		}
 	}
@@ -123,10 +515,149 @@ static inline void __mempool_recycle(struct mempool *mp, const unsigned int rese
 void mempool_recycle(struct mempool *mp, const unsigned int reserve)
 {
 	pthread_spin_lock(&mp->lock);
-	__mempool_recycle(mp, 0);
+	__mempool_recycle(mp, reserve);
 	pthread_spin_unlock(&mp->lock);
 }
 
+/*
+ * Working-set estimate decays by 1/(2^n) of the gap per trim call, but follows
+ * a higher interval peak immediately.
+ */
+#define MEMPOOL_TRIM_DECAY_SHIFT (2)
+
+/*
+ * Keep 1/(2^n) of the working set as slack in free list.
+ */
+#define MEMPOOL_TRIM_SLACK_SHIFT (3)
+
+/*
+ * Slices detached per lock hold. Keep it small so that alloc/free on other
+ * threads never wait long behind the trimmer.
+ */
+#define MEMPOOL_TRIM_LOCK_BATCH (16)
+
+static inline unsigned long __mempool_trim_target(struct mempool *mp)
+{
+	unsigned long inuse = mempool_inuse(mp);
+	unsigned long target, excess;
+
+	if (mp->interval_peak >= mp->ws)
+	{
+		mp->ws = mp->interval_peak;
+	}
+	else
+	{
+		mp->ws -= (mp->ws - mp->interval_peak + (1 << MEMPOOL_TRIM_DECAY_SHIFT) - 1) >> MEMPOOL_TRIM_DECAY_SHIFT;
+	}
+
+	/* Start a new interval. */
+	mp->interval_peak = inuse;
+
+	target = mp->ws + (mp->ws >> MEMPOOL_TRIM_SLACK_SHIFT);
+	if (mp->ref <= target)
+	{
+		return 0;
+	}
+
+	excess = mp->ref - target;
+	if (excess > mp->nr_free)
+	{
+		excess = mp->nr_free;
+	}
+
+	if (excess > mp->trim_batch)
+	{
+		excess = mp->trim_batch;
+	}
+
+	return excess;
+}
+
+/*!
+ * @brief Set max slices released by one mempool_trim() call. 0: disable adaptive trim.
+ */
+void mempool_set_trim_batch(struct mempool *mp, const unsigned int batch)
+{
+	pthread_spin_lock(&mp->lock);
+	mp->trim_batch = batch;
+	pthread_spin_unlock(&mp->lock);
+}
+
+/*!
+ * @brief Release idle slices exceeding the working-set estimate.
+ *
+ * @details Call this periodically from a maintenance hook. Each call closes one
+ * sampling interval: the working-set estimate follows the in-use peak of the
+ * interval, and decays slowly when the peak drops. At most trim_batch cold
+ * slices (free list tail) are released per call, so memory is returned
+ * gradually after a traffic spike. The pool lock is only held to detach a few
+ * slices at a time; free(3) runs unlocked.
+ *
+ * @return Number of released slices.
+ */
+unsigned long mempool_trim(struct mempool *mp)
+{
+	struct mempool_slice *slice, *slice_save;
+	struct list_head list_trim;
+	unsigned long excess, n, total = 0;
+
+	pthread_spin_lock(&mp->lock);
+	excess = __mempool_trim_target(mp);
+	pthread_spin_unlock(&mp->lock);
+
+	while (excess)
+	{
+		INIT_LIST_HEAD(&list_trim);
+
+		pthread_spin_lock(&mp->lock);
+		for (n = 0; n < MEMPOOL_TRIM_LOCK_BATCH && n < excess && !list_empty(&mp->list_free); n++)
+		{
+			slice = list_entry(mp->list_free.prev, struct mempool_slice, list);
+			list_move(&slice->list, &list_trim);
+
+			mp->nr_free--;
+			mp->ref--;
+		}
+		pthread_spin_unlock(&mp->lock);
+
+		if (n == 0)
+		{
+			break;
+		}
+
+		list_for_each_entry_safe(slice, slice_save, &list_trim, list)
+		{
+			BUG_ON(slice->magic != MEMPOOL_SLICE_MAGIC);
+			free(slice);
+		}
+
+		excess -= n;
+		total += n;
+	}
+
+	return total;
+}
+
+/*!
+ * @brief Run mempool_trim() on every registered pool.
+ *
+ * @return Number of released slices.
+ */
+unsigned long mempool_trim_all(void)
+{
+	struct mempool *mp;
+	unsigned long total = 0;
+
+	pthread_mutex_lock(&mempool_registry_lock);
+	list_for_each_entry(mp, &mempool_registry, list_registry)
+	{
+		total += mempool_trim(mp);
+	}
+	pthread_mutex_unlock(&mempool_registry_lock);
+
+	return total;
+}
+
 /*!
  * @brief Calculate a proper size for one slice.
  */
@@ -178,15 +709,72 @@ int mempool_init(
 
 	mp->fail = 0;
 
+	mp->nr_free = 0;
+	mp->peak = 0;
+	mp->nr_alloc = 0;
+	mp->nr_free_call = 0;
+	mp->hit = 0;
+	mp->miss = 0;
+
+	mp->interval_peak = 0;
+	mp->ws = 0;
+	mp->trim_batch = MEMPOOL_TRIM_BATCH_DFL;
+
 	INIT_LIST_HEAD(&mp->list_free);
 
+#if HAVE_MEMPOOL_GUARD
+	INIT_LIST_HEAD(&mp->list_quarantine);
+	mp->nr_quarantine = 0;
+#endif
+
 	pthread_spin_init(&mp->lock, 0);
 
+	pthread_mutex_lock(&mempool_registry_lock);
+	list_add_tail(&mp->list_registry, &mempool_registry);
+	pthread_mutex_unlock(&mempool_registry_lock);
+
+	if (mp->tls == MEMPOOL_TLS_MAGIC)
+	{
+		mp->tls_next = mempool_tls_list;
+		mempool_tls_list = mp;
+
+		pthread_once(&mempool_tls_once, mempool_tls_key_init);
+		(void) pthread_setspecific(mempool_tls_key, mp);
+	}
+
 	return 0;
 }
 
 void mempool_exit(struct mempool *mp)
 {
+	struct mempool **pp;
+
+	if (mp->tls == MEMPOOL_TLS_MAGIC)
+	{
+		/* A TLS pool is exited by its own thread: unlink it from this thread's list. */
+		for (pp = &mempool_tls_list; *pp; pp = &(*pp)->tls_next)
+		{
+			if (*pp == mp)
+			{
+				*pp = mp->tls_next;
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_lock(&mempool_registry_lock);
+	list_del(&mp->list_registry);
+	pthread_mutex_unlock(&mempool_registry_lock);
+
+#if HAVE_MEMPOOL_GUARD
+	/*
+	 * Release quarantine.
+	 */
+	list_splice_init(&mp->list_quarantine, &mp->list_free);
+	mp->nr_free += mp->nr_quarantine;
+	mp->nr_quarantine = 0;
+#endif
+
 	/*
 	 * Recycle
 	 */
@@ -202,3 +790,81 @@ void mempool_exit(struct mempool *mp)
 
 	pthread_spin_destroy(&mp->lock);
 }
+
+/*!
+ * @brief Take a snapshot of pool counters.
+ */
+void mempool_get_stat(struct mempool *mp, struct mempool_stat *stat)
+{
+	pthread_spin_lock(&mp->lock);
+	{
+		stat->sz = mp->sz;
+		stat->max = mp->max;
+		stat->ref = mp->ref;
+		stat->nr_free = mp->nr_free;
+		stat->inuse = mempool_inuse(mp);
+		stat->peak = mp->peak;
+		stat->fail = mp->fail;
+		stat->ws = mp->ws;
+		stat->nr_alloc = mp->nr_alloc;
+		stat->nr_free_call = mp->nr_free_call;
+		stat->hit = mp->hit;
+		stat->miss = mp->miss;
+	}
+	pthread_spin_unlock(&mp->lock);
+
+	snprintf(stat->name, sizeof(stat->name), "%s", mp->name);
+}
+
+/*!
+ * @brief Walk through every registered pool and pass its snapshot to func.
+ *
+ * @details The registry is locked while walking. Do not call mempool_init() or
+ * mempool_exit() in func. A non-zero return value from func stops the walk.
+ *
+ * @return 0 if all pools are visited, or the non-zero value returned by func.
+ */
+int mempool_stat_foreach(mempool_stat_func_t func, void *priv)
+{
+	struct mempool *mp;
+	struct mempool_stat stat;
+	int ret = 0;
+
+	pthread_mutex_lock(&mempool_registry_lock);
+	list_for_each_entry(mp, &mempool_registry, list_registry)
+	{
+		mempool_get_stat(mp, &stat);
+
+		ret = func(&stat, priv);
+		if (ret)
+		{
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mempool_registry_lock);
+
+	return ret;
+}
+
+static int mempool_stat_dump_one(const struct mempool_stat *stat, void *priv)
+{
+	FILE *fp = (FILE *) priv;
+
+	fprintf(fp, "%-15s %8u %10lu %10lu %10lu %10lu %10lu %10lu %10lu %12llu %12llu %12llu %12llu\n",
+		stat->name, stat->sz, stat->max, stat->ref, stat->inuse, stat->nr_free, stat->peak, stat->ws, stat->fail,
+		stat->nr_alloc, stat->nr_free_call, stat->hit, stat->miss);
+
+	return 0;
+}
+
+/*!
+ * @brief Dump all registered pools as a table.
+ */
+void mempool_stat_dump(FILE *fp)
+{
+	fprintf(fp, "%-15s %8s %10s %10s %10s %10s %10s %10s %10s %12s %12s %12s %12s\n",
+		"name", "sz", "max", "ref", "inuse", "free", "peak", "ws", "fail",
+		"alloc", "free_call", "hit", "miss");
+
+	(void) mempool_stat_foreach(mempool_stat_dump_one, fp);
+}
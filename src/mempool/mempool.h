@@ -6,10 +6,25 @@
  * @brief Implement a kmem-cache-like memory pool.
  */
 
+#include <stdio.h>
 #include <stdint.h>
 #include <pthread.h>
 #include "lgu/lgu.h"
 
+/*
+ * Say 1 to debug use-after-free and overflow in pooled objects: red zones
+ * around each slice, poison fill on free, poison check on alloc and delayed
+ * reuse through a quarantine FIFO. Build every user of mempool with the same
+ * value because it changes struct mempool.
+ */
+#ifndef HAVE_MEMPOOL_GUARD
+#define HAVE_MEMPOOL_GUARD (0)
+#endif
+
+#ifndef MEMPOOL_GUARD_QUARANTINE_MAX
+#define MEMPOOL_GUARD_QUARANTINE_MAX (256) //!< Freed slices held back before reuse. 0: disable.
+#endif
+
 struct mempool
 {
 	unsigned int magic; //!< A magic num for debug purpose.
@@ -22,19 +37,70 @@ struct mempool
 	unsigned long max; //!< Max available. 0: unlimited
 	unsigned long fail; //!< Save the malloc failure number for debug purpose.
 
+	unsigned long nr_free; //!< Slice num in free list.
+	unsigned long peak; //!< Max in-use slice num ever seen.
+
+	unsigned long long nr_alloc; //!< Total mempool_alloc() num.
+	unsigned long long nr_free_call; //!< Total mempool_free() num.
+	unsigned long long hit; //!< Alloc served by free list.
+	unsigned long long miss; //!< Alloc served by malloc.
+
+	unsigned long interval_peak; //!< Max in-use slice num since last trim.
+	unsigned long ws; //!< Working-set estimate (in-use slices). Updated by mempool_trim().
+#define MEMPOOL_TRIM_BATCH_DFL (64)
+	unsigned int trim_batch; //!< Max slices released per mempool_trim(). 0: disable.
+
 	int (*ctor)(void *slice);
 	void (*dtor)(void *slice);
 
 	pthread_spinlock_t lock;
 
 	struct list_head list_free; //!< Available memory slice. Store cache-maybe-hot at head.
+
+	struct list_head list_registry; //!< Link to the global pool registry.
+
+#define MEMPOOL_TLS_MAGIC (0x54087153)
+	unsigned int tls; //!< MEMPOOL_TLS_MAGIC if defined by DEFINE_MEMPOOL_TLS. Exited at thread exit.
+	struct mempool *tls_next; //!< Next TLS pool of the same thread.
+
+#if HAVE_MEMPOOL_GUARD
+	struct list_head list_quarantine; //!< Freed slices waiting for reuse. Oldest at head.
+	unsigned long nr_quarantine;
+#endif
+};
+
+/*!
+ * @brief A snapshot of pool sizing data and counters.
+ */
+struct mempool_stat
+{
+	char name[MEMPOOL_NAME_MAX];
+	unsigned int sz; //!< Slice size.
+
+	unsigned long max; //!< Max available. 0: unlimited
+	unsigned long ref; //!< Allocated slice num. (in use + free list)
+	unsigned long nr_free; //!< Slice num in free list.
+	unsigned long inuse; //!< Slice num owned by callers.
+	unsigned long peak; //!< Max in-use slice num ever seen.
+	unsigned long fail;
+	unsigned long ws; //!< Working-set estimate.
+
+	unsigned long long nr_alloc;
+	unsigned long long nr_free_call;
+	unsigned long long hit;
+	unsigned long long miss;
 };
 
 #define DEFINE_MEMPOOL(_name) \
 	static struct mempool _name = { .magic = 0 }
 
+/*
+ * A pool per thread. A thread which exits without mempool_exit() has its pools
+ * exited by a thread-specific data destructor, so the registry never points to
+ * the freed TLS.
+ */
 #define DEFINE_MEMPOOL_TLS(_name) \
-	static __thread struct mempool _name = { .magic = 0 }
+	static __thread struct mempool _name = { .magic = 0, .tls = MEMPOOL_TLS_MAGIC }
 
 extern unsigned int mempool_calc_slice_size(const unsigned int input);
 
@@ -46,6 +112,18 @@ extern void mempool_exit(struct mempool *mp);
 
 extern void *mempool_alloc(struct mempool *mp);
 extern void mempool_free(struct mempool *mp, void *p);
+extern unsigned int mempool_alloc_bulk(struct mempool *mp, void **objs, const unsigned int n);
+extern void mempool_free_bulk(struct mempool *mp, void **objs, const unsigned int n);
 extern void mempool_recycle(struct mempool *mp, const unsigned int reserve);
 
+extern void mempool_set_trim_batch(struct mempool *mp, const unsigned int batch);
+extern unsigned long mempool_trim(struct mempool *mp);
+extern unsigned long mempool_trim_all(void);
+
+extern void mempool_get_stat(struct mempool *mp, struct mempool_stat *stat);
+
+typedef int (* mempool_stat_func_t)(const struct mempool_stat *stat, void *priv);
+extern int mempool_stat_foreach(mempool_stat_func_t func, void *priv);
+extern void mempool_stat_dump(FILE *fp);
+
 #endif /* SRC_MEMPOOL_MEMPOOL_H_ */
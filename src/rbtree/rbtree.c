@@ -663,3 +663,78 @@ struct rb_node *rb_first_postorder(const struct rb_root *root)
 	return rb_left_deepest_node(root->rb_node);
 }
 RB_EXPORT_SYMBOL(rb_first_postorder);
+
+/*
+ * Link nodes[lo, hi) as a balanced subtree under parent and return its root.
+ * Midpoint splitting keeps every leaf at depth full - 1 or full, where full
+ * is the number of completely filled levels. Nodes below the full levels are
+ * red and childless, the rest black, so all paths hold full black nodes.
+ */
+static struct rb_node *__rb_build_sorted(struct rb_node **nodes, size_t lo,
+					 size_t hi, struct rb_node *parent,
+					 unsigned int depth, unsigned int full)
+{
+	size_t mid;
+	struct rb_node *node;
+
+	if (lo >= hi)
+		return NULL;
+
+	mid = lo + (hi - lo) / 2;
+	node = nodes[mid];
+	rb_set_parent_color(node, parent, depth < full ? RB_BLACK : RB_RED);
+	node->rb_left = __rb_build_sorted(nodes, lo, mid, node, depth + 1, full);
+	node->rb_right = __rb_build_sorted(nodes, mid + 1, hi, node, depth + 1, full);
+
+	return node;
+}
+
+/*
+ * rb_build_sorted - build a tree from nodes already in order, in O(n)
+ *
+ * @nodes:	nr nodes, sorted the way the tree's search compares them
+ * @nr:		number of nodes
+ * @root:	an empty tree
+ *
+ * No comparison and no rotation is done. The result is a valid, balanced
+ * rbtree, as if the nodes were inserted one by one; insert and erase work on
+ * it as usual. For an rb_root_cached, set rb_leftmost to nodes[0].
+ * Augmented trees must compute their augmented data afterwards, bottom up,
+ * e.g. by rb_first_postorder()/rb_next_postorder().
+ */
+void rb_build_sorted(struct rb_node **nodes, size_t nr, struct rb_root *root)
+{
+	unsigned int full = 0;
+
+	/* Levels 0..full-1 are complete: 2^full - 1 <= nr */
+	while (full < sizeof(size_t) * 8 && ((size_t)2 << full) - 1 <= nr)
+		full++;
+
+	root->rb_node = __rb_build_sorted(nodes, 0, nr, NULL, 0, full);
+}
+RB_EXPORT_SYMBOL(rb_build_sorted);
+
+/*
+ * rb_destroy - take down a whole tree, in O(n)
+ *
+ * @root:	the tree, empty on return
+ * @free_fn:	called once per node, may free it
+ * @arg:	passed to free_fn
+ *
+ * Nodes are visited in postorder, so children go before their parent, and
+ * the next node is found before free_fn() is called. Unlike rb_erase() in a
+ * loop there is no rebalancing nor recoloring, and each node is touched once.
+ */
+void rb_destroy(struct rb_root *root,
+		void (*free_fn)(struct rb_node *node, void *arg), void *arg)
+{
+	struct rb_node *node, *next;
+
+	for (node = rb_first_postorder(root); node; node = next) {
+		next = rb_next_postorder(node);
+		free_fn(node, arg);
+	}
+
+	root->rb_node = NULL;
+}
+RB_EXPORT_SYMBOL(rb_destroy);
@@ -33,50 +33,28 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#if (1)
-#define __rb_force
-#else
-#define __rb_force __attribute__((force))
-#endif
-
 #define rb_container_of(ptr, type, member) ({ \
 		typeof( ((type *)0)->member ) *__mptr = (ptr); \
 		(type *)( (char *)__mptr - offsetof(type, member) );})
 
-#if (1)
-#define rb_rcu_assign_pointer(_p, _pin) do { _p = (_pin); } while (0)
-#define rb_barrier() do { } while (0)
-#define rb_memcpy(_p, _src, _len) __builtin_memcpy((void *) p, (const void *) res, size)
-#else
-#define rb_rcu_assign_pointer(_p, _pin) _p = (_pin) // FIXME
-#define rb_barrier() asm volatile ("" : : : "memory")
-#define rb_memcpy(_p, _src, _len) __builtin_memcpy((void *) p, (const void *) res, size)
-#endif
+/*
+ * Publish a pointer to lockless readers: stores to the pointed node before this
+ * are visible to a reader which loads the pointer by rb_rcu_dereference().
+ * See rbtree_rcu.h for read-side locking and reclamation.
+ */
+#define rb_rcu_assign_pointer(_p, _pin) __atomic_store_n(&(_p), (_pin), __ATOMIC_RELEASE)
+#define rb_rcu_dereference(_p) __atomic_load_n(&(_p), __ATOMIC_ACQUIRE)
+#define RB_READ_ONCE(_x) __atomic_load_n(&(_x), __ATOMIC_RELAXED)
+#define rb_barrier() __asm__ __volatile__ ("" : : : "memory")
 
 #define RB_EXPORT_SYMBOL(...)
 
-static __attribute__((unused)) void __rb_write_once_size(volatile void *p, void *res, int size)
-{
-	switch (size)
-	{
-	case 1: *(volatile uint8_t *)p = *(uint8_t *)res; break;
-	case 2: *(volatile uint16_t *)p = *(uint16_t *)res; break;
-	case 4: *(volatile uint32_t *)p = *(uint32_t *)res; break;
-	case 8: *(volatile uint64_t *)p = *(uint64_t *)res; break;
-	default:
-		rb_barrier();
-		rb_memcpy((void *)p, (const void *)res, size);
-		rb_barrier();
-	}
-}
-
-#define RB_WRITE_ONCE(x, val) \
-	({							\
-		union { typeof(x) __val; char __c[1]; } __u =	\
-			{ .__val = (__rb_force typeof(x)) (val) }; \
-		__rb_write_once_size(&(x), __u.__c, sizeof(x));	\
-		__u.__val;					\
-	})
+/*
+ * A single store a concurrent reader sees whole. Done by __atomic so the compiler
+ * neither tears it nor moves it across plain accesses of the same type (a store
+ * through a cast integer pointer breaks strict aliasing at -O2).
+ */
+#define RB_WRITE_ONCE(x, val) __atomic_store_n(&(x), (val), __ATOMIC_RELAXED)
 
 struct rb_node
 {
@@ -112,7 +90,7 @@ struct rb_root_cached
 #define RB_ROOT_CACHED (struct rb_root_cached) { {NULL, }, NULL }
 #define	rb_entry(ptr, type, member) rb_container_of(ptr, type, member)
 
-#define RB_EMPTY_ROOT(root)  (READ_ONCE((root)->rb_node) == NULL)
+#define RB_EMPTY_ROOT(root)  (RB_READ_ONCE((root)->rb_node) == NULL)
 
 /* 'empty' nodes are nodes that are known not to be inserted in an rbtree */
 #define RB_EMPTY_NODE(node)  \
@@ -141,6 +119,10 @@ extern void rb_erase_cached(struct rb_node *node, struct rb_root_cached *);
 extern struct rb_node *rb_first_postorder(const struct rb_root *);
 extern struct rb_node *rb_next_postorder(const struct rb_node *);
 
+/* Bulk operations: build from sorted nodes, and free all nodes, in O(n) */
+extern void rb_build_sorted(struct rb_node **nodes, size_t nr, struct rb_root *root);
+extern void rb_destroy(struct rb_root *root, void (*free_fn)(struct rb_node *node, void *arg), void *arg);
+
 /* Fast replacement of a single node without remove/rebalance/add/rebalance */
 extern void rb_replace_node(struct rb_node *victim, struct rb_node *new, struct rb_root *root);
 extern void rb_replace_node_rcu(struct rb_node *victim, struct rb_node *new, struct rb_root *root);
@@ -0,0 +1,257 @@
+/*
+ * Interval tree and order-statistics tree benchmark.
+ *
+ * Usage: rbtree_aug_bench [perf_loops [nodes]]
+ *
+ * First both trees are checked against brute force on a small random set,
+ * through inserts and erases. Then NODES random nodes are inserted, queried
+ * and erased, PERF_LOOPS times. Interval queries are stabbing queries with
+ * about QUERY_HITS results each.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "rbtree_interval.h"
+#include "rbtree_ost.h"
+
+#define NODES       100000
+#define PERF_LOOPS  100
+#define QUERY_HITS  4
+#define CHECK_NODES 512
+#define CHECK_LOOPS 200
+
+struct bench_node
+{
+	struct rb_itree_node it;
+	struct rb_ost_node ost;
+};
+
+static struct bench_node *nodes;
+static unsigned int nr_nodes = NODES;
+static unsigned char alive[CHECK_NODES]; //!< Nodes in the trees during check()
+
+/*
+ * Intervals of random start and length, spread so a point hits about QUERY_HITS of them.
+ */
+static void init_nodes(const unsigned int nr, const unsigned long space)
+{
+	unsigned int j;
+
+	for (j = 0; j < nr; j++)
+	{
+		nodes[j].it.start = random() % space;
+		nodes[j].it.last = nodes[j].it.start + random() % (2 * QUERY_HITS * space / nr + 1);
+		nodes[j].ost.key = random() % space;
+	}
+}
+
+static int check_itree(const struct rb_root *root, const unsigned int nr, const unsigned long space)
+{
+	struct rb_itree_node *it;
+	unsigned long start, last, prev;
+	unsigned int q, j, expect, got;
+
+	for (q = 0; q < 64; q++)
+	{
+		start = random() % space;
+		last = start + random() % (space / 16 + 1);
+
+		expect = 0;
+		for (j = 0; j < nr; j++)
+			expect += alive[j] && (nodes[j].it.start <= last && start <= nodes[j].it.last);
+
+		got = 0;
+		prev = 0;
+		rb_itree_for_each(it, root, start, last)
+		{
+			if (it->start > last || start > it->last || it->start < prev)
+				return -1;
+			prev = it->start;
+			got++;
+		}
+
+		if (got != expect)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int check_ost(const struct rb_root *root, const unsigned int nr)
+{
+	struct rb_ost_node *ost;
+	unsigned int j, k, less, count = 0;
+
+	for (j = 0; j < nr; j++)
+		count += alive[j];
+
+	if (rb_ost_count(root) != count)
+		return -1;
+
+	for (j = 0; j < nr; j++)
+	{
+		if (!alive[j])
+			continue;
+
+		less = 0;
+		for (k = 0; k < nr; k++)
+			less += alive[k] && (nodes[k].ost.key < nodes[j].ost.key);
+
+		/* Equal keys sit in [less, less + equal), so the node at rank less holds the same key. */
+		ost = rb_ost_select(root, less);
+		if (ost == NULL || ost->key != nodes[j].ost.key)
+			return -1;
+		if (rb_ost_rank_key(root, nodes[j].ost.key) != less)
+			return -1;
+		if (rb_ost_select(root, rb_ost_rank(&nodes[j].ost)) != &nodes[j].ost)
+			return -1;
+	}
+
+	return rb_ost_select(root, count) == NULL ? 0 : -1;
+}
+
+static int check(void)
+{
+	struct rb_root it_root = RB_ROOT, ost_root = RB_ROOT;
+	unsigned int i, j, nr;
+
+	for (i = 0; i < CHECK_LOOPS; i++)
+	{
+		nr = 1 + random() % CHECK_NODES;
+		init_nodes(nr, 4096);
+		for (j = 0; j < nr; j++)
+			alive[j] = 1;
+
+		for (j = 0; j < nr; j++)
+		{
+			rb_itree_insert(&nodes[j].it, &it_root);
+			rb_ost_insert(&nodes[j].ost, &ost_root);
+		}
+
+		if (check_itree(&it_root, nr, 4096) || check_ost(&ost_root, nr))
+			return -1;
+
+		/* Erase a random half. */
+		for (j = 0; j < nr; j++)
+		{
+			alive[j] = random() & 1;
+			if (!alive[j])
+			{
+				rb_itree_remove(&nodes[j].it, &it_root);
+				rb_ost_erase(&nodes[j].ost, &ost_root);
+			}
+		}
+
+		if (check_itree(&it_root, nr, 4096) || check_ost(&ost_root, nr))
+			return -1;
+
+		for (j = 0; j < nr; j++)
+		{
+			if (alive[j])
+			{
+				rb_itree_remove(&nodes[j].it, &it_root);
+				rb_ost_erase(&nodes[j].ost, &ost_root);
+			}
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct rb_root it_root = RB_ROOT, ost_root = RB_ROOT;
+	struct rb_itree_node *it;
+	unsigned int loops = PERF_LOOPS, i, j;
+	uint64_t t, ns_insert, ns_query, ns_erase, ns_select, ns_rank;
+	unsigned long hits = 0, space, p;
+
+	loops = bench_arg(argc, argv, 1, PERF_LOOPS);
+	nr_nodes = bench_arg(argc, argv, 2, NODES);
+	if (loops == 0 || nr_nodes == 0)
+	{
+		return bench_usage(argv[0], "[perf_loops [nodes]]");
+	}
+
+	nodes = calloc(nr_nodes > CHECK_NODES ? nr_nodes : CHECK_NODES, sizeof(*nodes));
+	if (nodes == NULL)
+	{
+		return 1;
+	}
+
+	if (check())
+	{
+		fprintf(stderr, "BUG: tree disagrees with brute force\n");
+		return 1;
+	}
+
+	space = (unsigned long) nr_nodes * 1024;
+	init_nodes(nr_nodes, space);
+
+	printf("tree,op,nodes,loops,ns_per_op\n");
+
+	ns_insert = ns_query = ns_erase = 0;
+	for (i = 0; i < loops; i++)
+	{
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			rb_itree_insert(&nodes[j].it, &it_root);
+		ns_insert += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+		{
+			p = nodes[j].ost.key;
+			rb_itree_for_each(it, &it_root, p, p)
+				hits++;
+		}
+		ns_query += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			rb_itree_remove(&nodes[j].it, &it_root);
+		ns_erase += bench_now_ns() - t;
+	}
+
+	bench_print_result("itree", "insert", ns_insert, nr_nodes, loops);
+	bench_print_result("itree", "stab", ns_query, nr_nodes, loops);
+	bench_print_result("itree", "erase", ns_erase, nr_nodes, loops);
+
+	ns_insert = ns_select = ns_rank = ns_erase = 0;
+	for (i = 0; i < loops; i++)
+	{
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			rb_ost_insert(&nodes[j].ost, &ost_root);
+		ns_insert += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			hits += (rb_ost_select(&ost_root, j) != NULL);
+		ns_select += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			hits += rb_ost_rank(&nodes[j].ost);
+		ns_rank += bench_now_ns() - t;
+
+		t = bench_now_ns();
+		for (j = 0; j < nr_nodes; j++)
+			rb_ost_erase(&nodes[j].ost, &ost_root);
+		ns_erase += bench_now_ns() - t;
+	}
+
+	bench_print_result("ost", "insert", ns_insert, nr_nodes, loops);
+	bench_print_result("ost", "select", ns_select, nr_nodes, loops);
+	bench_print_result("ost", "rank", ns_rank, nr_nodes, loops);
+	bench_print_result("ost", "erase", ns_erase, nr_nodes, loops);
+
+	/* Keep the queries from being optimized out. */
+	fprintf(stderr, "hits %lu\n", hits);
+
+	free(nodes);
+	return 0;
+}
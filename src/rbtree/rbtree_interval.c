@@ -0,0 +1,185 @@
+/*
+ * rbtree_interval: interval tree on the augmented rbtree.
+ *
+ * Port of linux/include/linux/interval_tree_generic.h for unsigned long
+ * endpoints.
+ */
+
+#include "rbtree_augmented.h"
+#include "rbtree_interval.h"
+
+#define rb_itree_entry(_rb) rb_entry((_rb), struct rb_itree_node, rb)
+
+static inline unsigned long rb_itree_compute_last(struct rb_itree_node *node)
+{
+	unsigned long max = node->last, sub;
+
+	if (node->rb.rb_left)
+	{
+		sub = rb_itree_entry(node->rb.rb_left)->__subtree_last;
+		if (max < sub)
+			max = sub;
+	}
+
+	if (node->rb.rb_right)
+	{
+		sub = rb_itree_entry(node->rb.rb_right)->__subtree_last;
+		if (max < sub)
+			max = sub;
+	}
+
+	return max;
+}
+
+RB_DECLARE_CALLBACKS(static, rb_itree_augment, struct rb_itree_node, rb,
+		     unsigned long, __subtree_last, rb_itree_compute_last)
+
+/*!
+ * \brief Insert node. node->start and node->last must be set.
+ */
+void rb_itree_insert(struct rb_itree_node *node, struct rb_root *root)
+{
+	struct rb_node **link = &root->rb_node, *rb_parent = NULL;
+	const unsigned long start = node->start, last = node->last;
+	struct rb_itree_node *parent;
+
+	while (*link)
+	{
+		rb_parent = *link;
+		parent = rb_itree_entry(rb_parent);
+
+		/* Every ancestor of the new node covers its last. */
+		if (parent->__subtree_last < last)
+			parent->__subtree_last = last;
+
+		if (start < parent->start)
+			link = &parent->rb.rb_left;
+		else
+			link = &parent->rb.rb_right;
+	}
+
+	node->__subtree_last = last;
+	rb_link_node(&node->rb, rb_parent, link);
+	rb_insert_augmented(&node->rb, root, &rb_itree_augment);
+}
+
+void rb_itree_remove(struct rb_itree_node *node, struct rb_root *root)
+{
+	rb_erase_augmented(&node->rb, root, &rb_itree_augment);
+}
+
+/*
+ * Leftmost node of the subtree of node which overlaps [start, last].
+ * The caller made sure start <= node->__subtree_last.
+ */
+static struct rb_itree_node *rb_itree_subtree_search(struct rb_itree_node *node, const unsigned long start, const unsigned long last)
+{
+	struct rb_itree_node *left;
+
+	for (;;)
+	{
+		/* Any overlap in the left subtree comes first in order. */
+		if (node->rb.rb_left)
+		{
+			left = rb_itree_entry(node->rb.rb_left);
+			if (start <= left->__subtree_last)
+			{
+				node = left;
+				continue;
+			}
+		}
+
+		/* Nodes on the right start even later. */
+		if (node->start > last)
+		{
+			return NULL;
+		}
+
+		if (start <= node->last)
+		{
+			return node;
+		}
+
+		if (node->rb.rb_right == NULL)
+		{
+			return NULL;
+		}
+
+		node = rb_itree_entry(node->rb.rb_right);
+		if (start > node->__subtree_last)
+		{
+			return NULL;
+		}
+	}
+}
+
+/*!
+ * \brief Find the first node overlapping [start, last].
+ *
+ * \return node with the least start, or NULL if none
+ */
+struct rb_itree_node *rb_itree_iter_first(const struct rb_root *root, const unsigned long start, const unsigned long last)
+{
+	struct rb_itree_node *node;
+
+	if (root->rb_node == NULL)
+	{
+		return NULL;
+	}
+
+	node = rb_itree_entry(root->rb_node);
+	if (node->__subtree_last < start)
+	{
+		return NULL;
+	}
+
+	return rb_itree_subtree_search(node, start, last);
+}
+
+/*!
+ * \brief Find the next node after node overlapping [start, last].
+ *
+ * \return next node, or NULL if none
+ */
+struct rb_itree_node *rb_itree_iter_next(struct rb_itree_node *node, const unsigned long start, const unsigned long last)
+{
+	struct rb_node *rb = node->rb.rb_right, *prev;
+	struct rb_itree_node *right;
+
+	for (;;)
+	{
+		/* Overlaps in the right subtree come before any ancestor's. */
+		if (rb)
+		{
+			right = rb_itree_entry(rb);
+			if (start <= right->__subtree_last)
+			{
+				return rb_itree_subtree_search(right, start, last);
+			}
+		}
+
+		/* Climb until we come up from a left child. */
+		do
+		{
+			rb = rb_parent(&node->rb);
+			if (rb == NULL)
+			{
+				return NULL;
+			}
+
+			prev = &node->rb;
+			node = rb_itree_entry(rb);
+			rb = node->rb.rb_right;
+		} while (prev == rb);
+
+		if (node->start > last)
+		{
+			return NULL;
+		}
+
+		if (start <= node->last)
+		{
+			return node;
+		}
+	}
+}
@@ -0,0 +1,46 @@
+/*
+ * rbtree_interval: interval tree on the augmented rbtree.
+ *
+ * Every node holds a closed interval [start, last]. Nodes are sorted by start,
+ * and each caches the largest last in its subtree, so an overlap query visits
+ * O(log n + k) nodes for k results. Overlapping and equal intervals are fine.
+ *
+ *   struct rule
+ *   {
+ *       struct rb_itree_node it;  // it.start, it.last: port range
+ *       ...
+ *   };
+ *
+ *   struct rb_root root = RB_ROOT;
+ *
+ *   rb_itree_insert(&rule->it, &root);
+ *   rb_itree_for_each(it, &root, port, port)
+ *       rule = rb_entry(it, struct rule, it);
+ */
+
+#ifndef RBTREE_INTERVAL_H_
+#define RBTREE_INTERVAL_H_
+
+#include "rbtree.h"
+
+struct rb_itree_node
+{
+	struct rb_node rb;
+	unsigned long start; //!< First point of the interval
+	unsigned long last; //!< Last point of the interval, inclusive
+	unsigned long __subtree_last; //!< Private: max last in this subtree
+};
+
+extern void rb_itree_insert(struct rb_itree_node *node, struct rb_root *root);
+extern void rb_itree_remove(struct rb_itree_node *node, struct rb_root *root);
+extern struct rb_itree_node *rb_itree_iter_first(const struct rb_root *root, const unsigned long start, const unsigned long last);
+extern struct rb_itree_node *rb_itree_iter_next(struct rb_itree_node *node, const unsigned long start, const unsigned long last);
+
+/*
+ * Iterate nodes overlapping [start, last] in order of their start.
+ * Do not remove pos in the loop.
+ */
+#define rb_itree_for_each(pos, root, start, last) \
+	for (pos = rb_itree_iter_first((root), (start), (last)); pos; pos = rb_itree_iter_next(pos, (start), (last)))
+
+#endif /* RBTREE_INTERVAL_H_ */
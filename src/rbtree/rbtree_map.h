@@ -0,0 +1,184 @@
+/*
+ * rbtree_map: typed rbtree maps generated by a macro.
+ *
+ * rbtree.h leaves the insert and search loops to the user. RB_DEFINE_MAP()
+ * writes them once per type, with the comparator inlined, so each map gets a
+ * fully specialized hot path and no callback.
+ *
+ *   struct conn
+ *   {
+ *       uint32_t ip;
+ *       struct rb_node rb;
+ *   };
+ *
+ *   RB_DEFINE_MAP(conn_map, struct conn, rb, ip, RB_MAP_CMP_NUM)
+ *
+ *   struct rb_root root = RB_ROOT;
+ *
+ *   conn_map_insert(&root, c);           // NULL if ok, else the node with the same key
+ *   c = conn_map_find(&root, ip);
+ *   conn_map_erase(&root, c);
+ *
+ *   rb_map_for_each_range(conn_map, c, &root, lo, hi)
+ *       ...                              // lo <= c->ip <= hi, in order
+ *
+ * cmp(a, b) gets two keys and returns < 0, 0 or > 0. Keys are unique.
+ */
+
+#ifndef RBTREE_MAP_H_
+#define RBTREE_MAP_H_
+
+#include "rbtree.h"
+
+/* Comparator of numeric keys */
+#define RB_MAP_CMP_NUM(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+
+#define RB_DEFINE_MAP(name, type, member, key, cmp) \
+\
+typedef __typeof__(((type *) 0)->key) name##_key_t; \
+\
+static inline type *name##_entry(struct rb_node *rb) \
+{ \
+	return (rb) ? rb_entry(rb, type, member) : NULL; \
+} \
+\
+/* Find the node of k. NULL if not found. */ \
+static inline type *name##_find(const struct rb_root *root, const name##_key_t k) \
+{ \
+	struct rb_node *rb = root->rb_node; \
+	type *node; \
+	int c; \
+\
+	while (rb) \
+	{ \
+		node = rb_entry(rb, type, member); \
+		c = cmp(k, node->key); \
+		if (c < 0) \
+			rb = rb->rb_left; \
+		else if (c > 0) \
+			rb = rb->rb_right; \
+		else \
+			return node; \
+	} \
+\
+	return NULL; \
+} \
+\
+/* Insert node. Return NULL if ok, or the node already holding the same key. */ \
+static inline type *name##_insert(struct rb_root *root, type *node) \
+{ \
+	struct rb_node **link = &root->rb_node, *parent = NULL; \
+	type *cur; \
+	int c; \
+\
+	while (*link) \
+	{ \
+		parent = *link; \
+		cur = rb_entry(parent, type, member); \
+		c = cmp(node->key, cur->key); \
+		if (c < 0) \
+			link = &parent->rb_left; \
+		else if (c > 0) \
+			link = &parent->rb_right; \
+		else \
+			return cur; \
+	} \
+\
+	rb_link_node(&node->member, parent, link); \
+	rb_insert_color(&node->member, root); \
+	return NULL; \
+} \
+\
+static inline void name##_erase(struct rb_root *root, type *node) \
+{ \
+	rb_erase(&node->member, root); \
+} \
+\
+/* First node with key >= k. NULL if none. */ \
+static inline type *name##_lower_bound(const struct rb_root *root, const name##_key_t k) \
+{ \
+	struct rb_node *rb = root->rb_node, *found = NULL; \
+\
+	while (rb) \
+	{ \
+		if (cmp(rb_entry(rb, type, member)->key, k) >= 0) \
+		{ \
+			found = rb; \
+			rb = rb->rb_left; \
+		} \
+		else \
+		{ \
+			rb = rb->rb_right; \
+		} \
+	} \
+\
+	return name##_entry(found); \
+} \
+\
+/* First node with key > k. NULL if none. */ \
+static inline type *name##_upper_bound(const struct rb_root *root, const name##_key_t k) \
+{ \
+	struct rb_node *rb = root->rb_node, *found = NULL; \
+\
+	while (rb) \
+	{ \
+		if (cmp(rb_entry(rb, type, member)->key, k) > 0) \
+		{ \
+			found = rb; \
+			rb = rb->rb_left; \
+		} \
+		else \
+		{ \
+			rb = rb->rb_right; \
+		} \
+	} \
+\
+	return name##_entry(found); \
+} \
+\
+static inline type *name##_first(const struct rb_root *root) \
+{ \
+	return name##_entry(rb_first(root)); \
+} \
+\
+static inline type *name##_last(const struct rb_root *root) \
+{ \
+	return name##_entry(rb_last(root)); \
+} \
+\
+static inline type *name##_next(const type *node) \
+{ \
+	return name##_entry(rb_next(&node->member)); \
+} \
+\
+static inline type *name##_prev(const type *node) \
+{ \
+	return name##_entry(rb_prev(&node->member)); \
+} \
+\
+/* First node in [lo, hi]. NULL if none. */ \
+static inline type *name##_range_first(const struct rb_root *root, const name##_key_t lo, const name##_key_t hi) \
+{ \
+	type *node = name##_lower_bound(root, lo); \
+\
+	return (node && cmp(node->key, hi) <= 0) ? node : NULL; \
+} \
+\
+/* Next node of a range. NULL after hi. */ \
+static inline type *name##_range_next(const type *node, const name##_key_t hi) \
+{ \
+	type *next = name##_next(node); \
+\
+	return (next && cmp(next->key, hi) <= 0) ? next : NULL; \
+}
+
+/*
+ * Iterate nodes of map name with lo <= key <= hi, in order. Do not erase pos in the loop.
+ */
+#define rb_map_for_each_range(name, pos, root, lo, hi) \
+	for (pos = name##_range_first((root), (lo), (hi)); pos; pos = name##_range_next(pos, (hi)))
+
+#define rb_map_for_each(name, pos, root) \
+	for (pos = name##_first(root); pos; pos = name##_next(pos))
+
+#endif /* RBTREE_MAP_H_ */
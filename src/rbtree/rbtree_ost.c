@@ -0,0 +1,123 @@
+/*
+ * rbtree_ost: order-statistics tree on the augmented rbtree.
+ */
+
+#include "rbtree_augmented.h"
+#include "rbtree_ost.h"
+
+#define rb_ost_entry(_rb) rb_entry((_rb), struct rb_ost_node, rb)
+#define rb_ost_size(_rb) ((_rb) ? rb_ost_entry(_rb)->__size : 0)
+
+static inline unsigned long rb_ost_compute_size(struct rb_ost_node *node)
+{
+	return 1 + rb_ost_size(node->rb.rb_left) + rb_ost_size(node->rb.rb_right);
+}
+
+RB_DECLARE_CALLBACKS(static, rb_ost_augment, struct rb_ost_node, rb,
+		     unsigned long, __size, rb_ost_compute_size)
+
+/*!
+ * \brief Insert node. node->key must be set. Equal keys go after existing ones.
+ */
+void rb_ost_insert(struct rb_ost_node *node, struct rb_root *root)
+{
+	struct rb_node **link = &root->rb_node, *rb_parent = NULL;
+	const uint64_t key = node->key;
+	struct rb_ost_node *parent;
+
+	while (*link)
+	{
+		rb_parent = *link;
+		parent = rb_ost_entry(rb_parent);
+		parent->__size++;
+
+		if (key < parent->key)
+			link = &parent->rb.rb_left;
+		else
+			link = &parent->rb.rb_right;
+	}
+
+	node->__size = 1;
+	rb_link_node(&node->rb, rb_parent, link);
+	rb_insert_augmented(&node->rb, root, &rb_ost_augment);
+}
+
+void rb_ost_erase(struct rb_ost_node *node, struct rb_root *root)
+{
+	rb_erase_augmented(&node->rb, root, &rb_ost_augment);
+}
+
+/*!
+ * \brief Find the k-th smallest node, counting from 0.
+ *
+ * \return node, or NULL if k >= rb_ost_count()
+ */
+struct rb_ost_node *rb_ost_select(const struct rb_root *root, unsigned long k)
+{
+	struct rb_node *rb = root->rb_node;
+	unsigned long left;
+
+	while (rb)
+	{
+		left = rb_ost_size(rb->rb_left);
+		if (k < left)
+		{
+			rb = rb->rb_left;
+		}
+		else if (k == left)
+		{
+			return rb_ost_entry(rb);
+		}
+		else
+		{
+			k -= left + 1;
+			rb = rb->rb_right;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Position of node in order, counting from 0.
+ */
+unsigned long rb_ost_rank(const struct rb_ost_node *node)
+{
+	const struct rb_node *rb = &node->rb, *parent;
+	unsigned long rank = rb_ost_size(rb->rb_left);
+
+	/* Coming up from a right child, the parent and its left subtree are before us. */
+	for (parent = rb_parent(rb); parent; rb = parent, parent = rb_parent(rb))
+	{
+		if (parent->rb_right == rb)
+		{
+			rank += rb_ost_size(parent->rb_left) + 1;
+		}
+	}
+
+	return rank;
+}
+
+/*!
+ * \brief Number of nodes with a key less than key.
+ */
+unsigned long rb_ost_rank_key(const struct rb_root *root, const uint64_t key)
+{
+	struct rb_node *rb = root->rb_node;
+	unsigned long rank = 0;
+
+	while (rb)
+	{
+		if (key <= rb_ost_entry(rb)->key)
+		{
+			rb = rb->rb_left;
+		}
+		else
+		{
+			rank += rb_ost_size(rb->rb_left) + 1;
+			rb = rb->rb_right;
+		}
+	}
+
+	return rank;
+}
@@ -0,0 +1,64 @@
+/*
+ * rbtree_ost: order-statistics tree on the augmented rbtree.
+ *
+ * Every node caches the size of its subtree, so the k-th smallest key
+ * (select) and the position of a node or key (rank) are found in O(log n).
+ * Equal keys are allowed, which is what percentile tracking needs:
+ *
+ *   struct sample
+ *   {
+ *       struct rb_ost_node ost;  // ost.key: latency in ns
+ *       ...
+ *   };
+ *
+ *   struct rb_root root = RB_ROOT;
+ *
+ *   rb_ost_insert(&s->ost, &root);
+ *   p99 = rb_ost_percentile(&root, 99)->key;
+ */
+
+#ifndef RBTREE_OST_H_
+#define RBTREE_OST_H_
+
+#include "rbtree.h"
+
+struct rb_ost_node
+{
+	struct rb_node rb;
+	uint64_t key;
+	unsigned long __size; //!< Private: nodes in this subtree
+};
+
+extern void rb_ost_insert(struct rb_ost_node *node, struct rb_root *root);
+extern void rb_ost_erase(struct rb_ost_node *node, struct rb_root *root);
+extern struct rb_ost_node *rb_ost_select(const struct rb_root *root, unsigned long k);
+extern unsigned long rb_ost_rank(const struct rb_ost_node *node);
+extern unsigned long rb_ost_rank_key(const struct rb_root *root, const uint64_t key);
+
+/*!
+ * \brief Number of nodes in the tree. O(1).
+ */
+static inline unsigned long rb_ost_count(const struct rb_root *root)
+{
+	return root->rb_node ? rb_entry(root->rb_node, struct rb_ost_node, rb)->__size : 0;
+}
+
+/*!
+ * \brief Node at percentile pct (0 to 100) by the nearest-rank method.
+ *
+ * \return node, or NULL if the tree is empty
+ */
+static inline struct rb_ost_node *rb_ost_percentile(const struct rb_root *root, const unsigned int pct)
+{
+	unsigned long n = rb_ost_count(root), k;
+
+	if (n == 0)
+	{
+		return NULL;
+	}
+
+	k = (n * pct + 99) / 100;
+	return rb_ost_select(root, k ? k - 1 : 0);
+}
+
+#endif /* RBTREE_OST_H_ */
@@ -0,0 +1,183 @@
+/*
+ * rbtree_rcu: user-space RCU (epoch based) for lockless rbtree readers.
+ *
+ * The global epoch only moves forward. A reader records the epoch it saw when
+ * it entered, or 0 when it is outside. rb_synchronize_rcu() bumps the epoch
+ * and waits for every reader which recorded an older one: those are the only
+ * readers that may hold a pointer unlinked before the bump.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "rbtree_rcu.h"
+
+#define RB_RCU_SPIN_MAX (1024)
+
+unsigned long rb_rcu_epoch = 1;
+__thread struct rb_rcu_reader *rb_rcu_reader_self = NULL;
+
+static struct rb_rcu_reader *rb_rcu_readers = NULL;
+static pthread_mutex_t rb_rcu_gp_lock = PTHREAD_MUTEX_INITIALIZER; //!< Protect reader list, serialize grace periods.
+
+static struct rb_rcu_head *rb_rcu_cb_list = NULL;
+static unsigned int rb_rcu_cb_nr = 0;
+static pthread_mutex_t rb_rcu_cb_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * \brief Register the calling thread as a reader.
+ *
+ * \return 0 if ok
+ * \return -1 if cannot alloc memory
+ */
+int rb_rcu_register_thread(void)
+{
+	struct rb_rcu_reader *r;
+
+	if (rb_rcu_reader_self)
+	{
+		return 0;
+	}
+
+	if (posix_memalign((void **) &r, RB_RCU_CACHELINE, sizeof(*r)))
+	{
+		return -1;
+	}
+
+	r->epoch = 0;
+	r->nest = 0;
+
+	pthread_mutex_lock(&rb_rcu_gp_lock);
+	r->next = rb_rcu_readers;
+	rb_rcu_readers = r;
+	pthread_mutex_unlock(&rb_rcu_gp_lock);
+
+	rb_rcu_reader_self = r;
+	return 0;
+}
+
+/*!
+ * \brief Unregister the calling thread. Must be outside read-side sections.
+ */
+void rb_rcu_unregister_thread(void)
+{
+	struct rb_rcu_reader *r = rb_rcu_reader_self, **pp;
+
+	if (r == NULL)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&rb_rcu_gp_lock);
+	for (pp = &rb_rcu_readers; *pp; pp = &((*pp)->next))
+	{
+		if (*pp == r)
+		{
+			*pp = r->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&rb_rcu_gp_lock);
+
+	rb_rcu_reader_self = NULL;
+	free(r);
+}
+
+/*!
+ * \brief Wait until all readers which might see a node unlinked before this call have left.
+ */
+void rb_synchronize_rcu(void)
+{
+	struct rb_rcu_reader *r;
+	unsigned long epoch, seen;
+	unsigned int spin;
+
+	pthread_mutex_lock(&rb_rcu_gp_lock);
+
+	/* Only bumped under rb_rcu_gp_lock. Readers load it once. */
+	epoch = rb_rcu_epoch + 1;
+	WRITE_ONCE(rb_rcu_epoch, epoch);
+
+	/* Unlink stores and the epoch bump before loading reader epochs. Pairs with rb_rcu_read_lock(). */
+	smp_mb();
+
+	for (r = rb_rcu_readers; r; r = r->next)
+	{
+		spin = 0;
+		for (;;)
+		{
+			seen = smp_load_acquire(&(r->epoch));
+			if (seen == 0 || seen >= epoch)
+			{
+				break;
+			}
+
+			if (++spin < RB_RCU_SPIN_MAX)
+			{
+				__asm__ __volatile__ ("" : : : "memory");
+			}
+			else
+			{
+				/* The reader might be preempted. Let it run. */
+				spin = 0;
+				sched_yield();
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&rb_rcu_gp_lock);
+}
+
+/*!
+ * \brief Wait for a grace period, then run all queued callbacks.
+ */
+void rb_rcu_barrier(void)
+{
+	struct rb_rcu_head *head, *next;
+
+	pthread_mutex_lock(&rb_rcu_cb_lock);
+	head = rb_rcu_cb_list;
+	rb_rcu_cb_list = NULL;
+	rb_rcu_cb_nr = 0;
+	pthread_mutex_unlock(&rb_rcu_cb_lock);
+
+	if (head == NULL)
+	{
+		return;
+	}
+
+	rb_synchronize_rcu();
+
+	for (; head; head = next)
+	{
+		next = head->next;
+		head->func(head);
+	}
+}
+
+/*!
+ * \brief Call func(head) after a grace period. Usually to free the node of head.
+ *
+ * \note Callbacks run in the thread which calls rb_call_rcu() or rb_rcu_barrier(),
+ * batched by RB_RCU_BATCH. Call rb_rcu_barrier() before exit to run the rest.
+ */
+void rb_call_rcu(struct rb_rcu_head *head, void (*func)(struct rb_rcu_head *head))
+{
+	unsigned int nr;
+
+	head->func = func;
+
+	pthread_mutex_lock(&rb_rcu_cb_lock);
+	head->next = rb_rcu_cb_list;
+	rb_rcu_cb_list = head;
+	nr = ++rb_rcu_cb_nr;
+	pthread_mutex_unlock(&rb_rcu_cb_lock);
+
+	/* Never wait for a grace period inside a read-side section. It would wait for itself. */
+	if (nr >= RB_RCU_BATCH && (rb_rcu_reader_self == NULL || rb_rcu_reader_self->nest == 0))
+	{
+		rb_rcu_barrier();
+	}
+}
@@ -0,0 +1,131 @@
+/*
+ * rbtree_rcu: user-space RCU (epoch based) for lockless rbtree readers.
+ *
+ * One writer (or writers serialized by the caller's lock) modifies an rbtree
+ * with the usual rb_link_node_rcu()/rb_insert_color()/rb_erase(). Any number
+ * of reader threads search the tree at the same time without locks:
+ *
+ *   reader                                  writer
+ *   ------                                  ------
+ *   rb_rcu_register_thread();               lock(&tree_lock);
+ *                                           rb_rcu_write_begin(&seq);
+ *   rb_rcu_read_lock();                     rb_erase(&obj->rb, &root);
+ *   do {                                    rb_rcu_write_end(&seq);
+ *       s = rb_rcu_read_seq_begin(&seq);    unlock(&tree_lock);
+ *       obj = my_search(&root, key);
+ *   } while (!obj &&                        rb_call_rcu(&obj->rcu, my_free);
+ *            rb_rcu_read_seq_retry(&seq, s));
+ *   ... use obj ...
+ *   rb_rcu_read_unlock();
+ *
+ * - Readers must load child pointers with rb_rcu_dereference() in my_search.
+ * - A node is never freed while a reader that could see it is inside
+ *   rb_rcu_read_lock(). rb_synchronize_rcu() waits for such readers to leave.
+ * - Rotations may hide a subtree from a reader for a moment (never a loop,
+ *   never freed memory). rb_rcu_seq tells the reader to retry a miss.
+ *
+ * Readers take no lock and write only their own cache line. A read-side
+ * section may nest, and must not call rb_synchronize_rcu() or rb_rcu_barrier().
+ */
+
+#ifndef RBTREE_RCU_H_
+#define RBTREE_RCU_H_
+
+#include "rbtree.h"
+#include "atomic/atomic.h"
+
+#define RB_RCU_CACHELINE (64)
+#define RB_RCU_BATCH (64) //!< rb_call_rcu() reclaims every this many callbacks.
+
+struct rb_rcu_reader
+{
+	unsigned long epoch; //!< Global epoch seen at outermost read lock. 0 if not reading.
+	unsigned int nest;
+	struct rb_rcu_reader *next;
+} __attribute__((aligned(RB_RCU_CACHELINE)));
+
+extern __thread struct rb_rcu_reader *rb_rcu_reader_self;
+extern unsigned long rb_rcu_epoch;
+
+extern int rb_rcu_register_thread(void);
+extern void rb_rcu_unregister_thread(void);
+
+/*!
+ * \brief Enter a read-side critical section. The calling thread must be registered.
+ */
+static inline void rb_rcu_read_lock(void)
+{
+	struct rb_rcu_reader *r = rb_rcu_reader_self;
+
+	if (r->nest++ == 0)
+	{
+		WRITE_ONCE(r->epoch, READ_ONCE(rb_rcu_epoch));
+
+		/* Announce epoch before any load from the tree. Pairs with rb_synchronize_rcu(). */
+		smp_mb();
+	}
+}
+
+/*!
+ * \brief Leave a read-side critical section. Nodes seen inside must not be used after.
+ */
+static inline void rb_rcu_read_unlock(void)
+{
+	struct rb_rcu_reader *r = rb_rcu_reader_self;
+
+	if (--r->nest == 0)
+	{
+		smp_store_release(&r->epoch, 0);
+	}
+}
+
+extern void rb_synchronize_rcu(void);
+
+/*
+ * Deferred reclamation. Embed rb_rcu_head in the node, like rb_node.
+ */
+struct rb_rcu_head
+{
+	struct rb_rcu_head *next;
+	void (*func)(struct rb_rcu_head *head);
+};
+
+extern void rb_call_rcu(struct rb_rcu_head *head, void (*func)(struct rb_rcu_head *head));
+extern void rb_rcu_barrier(void);
+
+/*
+ * Writer sequence. Lets a reader tell a real miss from a miss during a rotation.
+ */
+typedef struct rb_rcu_seq
+{
+	unsigned int seq; //!< Odd while a writer is modifying the tree.
+} rb_rcu_seq_t;
+
+#define RB_RCU_SEQ_INITIALIZER { 0 }
+
+static inline void rb_rcu_write_begin(rb_rcu_seq_t *s)
+{
+	WRITE_ONCE(s->seq, s->seq + 1);
+	smp_wmb();
+}
+
+static inline void rb_rcu_write_end(rb_rcu_seq_t *s)
+{
+	smp_store_release(&s->seq, s->seq + 1);
+}
+
+static inline unsigned int rb_rcu_read_seq_begin(const rb_rcu_seq_t *s)
+{
+	return smp_load_acquire(&s->seq);
+}
+
+/*!
+ * \brief Return true if a writer ran (or is running) since rb_rcu_read_seq_begin().
+ */
+static inline bool rb_rcu_read_seq_retry(const rb_rcu_seq_t *s, const unsigned int seq)
+{
+	smp_rmb();
+	return (seq & 1) || READ_ONCE(s->seq) != seq;
+}
+
+#endif /* RBTREE_RCU_H_ */
@@ -2,20 +2,53 @@
  * Author : Muhammad Falak R Wani (mfrw)
  * This program is adapted from the linux kernel and in no way,
  * I claim I have any copyright.
+ *
+ * Usage: rbtree_test [perf_loops [nodes [seed]]]
+ *
+ * Benchmark: NODES keys are inserted, looked up in random order and erased,
+ * PERF_LOOPS times, for random, sequential and adversarial (alternating from
+ * both ends, which keeps rebalancing busy) keys. One CSV line per pattern and
+ * operation is printed to stdout, in TSC cycles per operation where there is
+ * a TSC, else in ns.
+ *
+ * Fuzz: random inserts, erases, lookups and bulk rebuilds are cross-checked
+ * against a reference model, and the tree invariants are validated as it
+ * goes. Any mismatch prints the seed to reproduce it and fails the run.
  */
 
 #include<stdio.h>
 #include<stdlib.h>
+#include<string.h>
 #include<time.h>
 #include<stdint.h>
+#include"bench.h"
 #include"rbtree.h"
 #include"rbtree_augmented.h"
-#include<sys/time.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include<x86intrin.h>
+#define TEST_UNIT "cycles"
+static inline uint64_t test_now(void)
+{
+	return __rdtsc();
+}
+#else
+#define TEST_UNIT "ns"
+static inline uint64_t test_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
 
 #define NODES       100000
-#define PERF_LOOPS  1000
-#define CHECK_LOOPS 10
+#define PERF_LOOPS  100
+#define FUZZ_NODES  1024
+#define FUZZ_OPS    2000000
+#define FUZZ_SMALL  64	/* Validate after every op while the tree is this small */
+#define FUZZ_EVERY  997	/* else every this many ops */
 
 struct test_node {
 	uint32_t key;
@@ -27,7 +60,9 @@ struct test_node {
 };
 
 static struct rb_root root = RB_ROOT;
-static struct test_node nodes[NODES];
+static struct test_node *nodes;
+static unsigned int *order;	/* Random permutation of nodes[] index */
+static unsigned int nr_nodes;
 
 
 static void insert(struct test_node *node, struct rb_root *root)
@@ -52,6 +87,24 @@ static inline void erase(struct test_node *node, struct rb_root *root)
 	rb_erase(&node->rb, root);
 }
 
+static struct test_node *lookup(struct rb_root *root, uint32_t key)
+{
+	struct rb_node *rb = root->rb_node;
+	struct test_node *node;
+
+	while (rb) {
+		node = rb_entry(rb, struct test_node, rb);
+		if (key < node->key)
+			rb = rb->rb_left;
+		else if (key > node->key)
+			rb = rb->rb_right;
+		else
+			return node;
+	}
+
+	return NULL;
+}
+
 static inline uint32_t augment_recompute(struct test_node *node)
 {
 	uint32_t max = node->val, child_augmented;
@@ -101,14 +154,15 @@ static void erase_augmented(struct test_node *node, struct rb_root *root)
 	rb_erase_augmented(&node->rb, root, &augment_callbacks);
 }
 
-static void init(void)
-{
-	int i;
-	for (i = 0; i < NODES; i++) {
-		nodes[i].key = random();
-		nodes[i].val = random();
-	}
-}
+/*
+ * Invariants. Each returns 0 if ok, else prints why and returns -1.
+ */
+#define CHECK(cond) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "BUG: %s:%d: %s\n", __func__, __LINE__, #cond); \
+		return -1;						\
+	}								\
+} while (0)
 
 static int is_red(struct rb_node *rb)
 {
@@ -123,138 +177,312 @@ static int black_path_count(struct rb_node *rb)
 	return count;
 }
 
-static void check_postorder_foreach(int nr_nodes)
+static int check_postorder_foreach(int nr_nodes)
 {
 	struct test_node *cur, *n;
 	int count = 0;
 	rbtree_postorder_for_each_entry_safe(cur, n, &root, rb)
 		count++;
 
+	CHECK(count == nr_nodes);
+	return 0;
 }
 
-static void check_postorder(int nr_nodes)
+static int check_postorder(int nr_nodes)
 {
 	struct rb_node *rb;
 	int count = 0;
 	for (rb = rb_first_postorder(&root); rb; rb = rb_next_postorder(rb))
 		count++;
 
+	CHECK(count == nr_nodes);
+	return 0;
 }
 
-static void check(int nr_nodes)
+static int check(int nr_nodes)
 {
-	struct rb_node *rb;
+	struct rb_node *rb, *parent;
 	int count = 0, blacks = 0;
 	uint32_t prev_key = 0;
 
+	CHECK(!root.rb_node || !is_red(root.rb_node));
+	CHECK(!root.rb_node || !rb_parent(root.rb_node));
+
 	for (rb = rb_first(&root); rb; rb = rb_next(rb)) {
 		struct test_node *node = rb_entry(rb, struct test_node, rb);
-		if (!count)
-			blacks = black_path_count(rb);
-		else
+
+		parent = rb_parent(rb);
+		CHECK(!parent || parent->rb_left == rb || parent->rb_right == rb);
+		CHECK(!count || node->key >= prev_key);
+		CHECK(!is_red(rb) || !parent || !is_red(parent));
+
+		/* Every path to a leaf holds the same number of black nodes. */
+		if (!rb->rb_left || !rb->rb_right) {
+			if (!blacks)
+				blacks = black_path_count(rb);
+			else
+				CHECK(black_path_count(rb) == blacks);
+		}
+
 		prev_key = node->key;
 		count++;
 	}
 
+	CHECK(count == nr_nodes);
 
-	check_postorder(nr_nodes);
-	check_postorder_foreach(nr_nodes);
+	if (check_postorder(nr_nodes) || check_postorder_foreach(nr_nodes))
+		return -1;
+	return 0;
 }
 
-static void check_augmented(int nr_nodes)
+static int check_augmented(int nr_nodes)
 {
 	struct rb_node *rb;
 
-	check(nr_nodes);
+	if (check(nr_nodes))
+		return -1;
 	for (rb = rb_first(&root); rb; rb = rb_next(rb)) {
 		struct test_node *node = rb_entry(rb, struct test_node, rb);
+		CHECK(node->augmented == augment_recompute(node));
 	}
+	return 0;
 }
 
-int main(void)
+/*
+ * Benchmark
+ */
+enum { KEYS_RANDOM, KEYS_SEQUENTIAL, KEYS_ADVERSARIAL, KEYS_MAX };
+
+static const char *keys_name[KEYS_MAX] = { "random", "sequential", "adversarial" };
+
+static void init(int keys)
 {
-	srand(time(NULL));
-	int i, j;
-
-	struct timeval begin, end;
-	double tm;
-	
-	printf("rbtree testing perf %u check %u nodes %u\n", PERF_LOOPS, CHECK_LOOPS, NODES);
-
-	init();
-	gettimeofday(&begin, NULL);
-
-	for (i = 0; i < PERF_LOOPS; i++) {
-		for (j = 0; j < NODES; j++)
-			insert(nodes + j, &root);
-		for (j = 0; j < NODES; j++)
-			erase(nodes + j, &root);
+	unsigned int i, k, tmp;
+
+	for (i = 0; i < nr_nodes; i++) {
+		switch (keys) {
+		case KEYS_SEQUENTIAL:
+			nodes[i].key = i;
+			break;
+		case KEYS_ADVERSARIAL:
+			/* 0, n-1, 1, n-2, ...: every insert lands at an edge */
+			nodes[i].key = (i & 1) ? nr_nodes - 1 - i / 2 : i / 2;
+			break;
+		default:
+			nodes[i].key = random();
+			break;
+		}
+		nodes[i].val = random();
+		order[i] = i;
 	}
 
-	/* here, do your tm-consuming job */
-	gettimeofday(&end, NULL);
-	tm = (end.tv_sec - begin.tv_sec) * 1000.0;
-	tm += (end.tv_usec - begin.tv_usec) / 1000.0;
-	printf(" -> %.0f ms / %.0f\n", (double)tm / PERF_LOOPS, tm);
-
-	gettimeofday(&begin, NULL);
-	for (i = 0; i < CHECK_LOOPS; i++) {
-		init();
-		for (j = 0; j < NODES; j++) {
-			check(j);
-			insert(nodes + j, &root);
-		}
-		for (j = 0; j < NODES; j++) {
-			check(NODES - j);
-			erase(nodes + j, &root);
-		}
-		check(0);
+	for (i = nr_nodes - 1; i > 0; i--) {
+		k = random() % (i + 1);
+		tmp = order[i];
+		order[i] = order[k];
+		order[k] = tmp;
 	}
+}
+
+static void print_result(const char *keys, const char *op, uint64_t t, unsigned int loops)
+{
+	printf("%s,%s,%u,%u,%.1f\n", keys, op, nr_nodes, loops,
+	       (double)t / ((double)loops * nr_nodes));
+}
 
-	gettimeofday(&end, NULL);
-	tm = (end.tv_sec - begin.tv_sec) * 1000.0;
-	tm += (end.tv_usec - begin.tv_usec) / 1000.0;
-	printf(" -> %.0f ms / %.0f\n", (double)tm / CHECK_LOOPS, tm);
+static unsigned long bench(unsigned int loops)
+{
+	unsigned long miss = 0;
+	uint64_t t, t_insert, t_lookup, t_erase;
+	unsigned int i, j;
+	int keys;
+
+	printf("keys,op,nodes,loops,%s_per_op\n", TEST_UNIT);
+
+	for (keys = 0; keys < KEYS_MAX; keys++) {
+		init(keys);
+		t_insert = t_lookup = t_erase = 0;
+
+		for (i = 0; i < loops; i++) {
+			t = test_now();
+			for (j = 0; j < nr_nodes; j++)
+				insert(nodes + j, &root);
+			t_insert += test_now() - t;
+
+			t = test_now();
+			for (j = 0; j < nr_nodes; j++)
+				miss += !lookup(&root, nodes[order[j]].key);
+			t_lookup += test_now() - t;
+
+			t = test_now();
+			for (j = 0; j < nr_nodes; j++)
+				erase(nodes + j, &root);
+			t_erase += test_now() - t;
+		}
 
-	/*
-	 *
-	 */
-	printf("augmented rbtree testing\n");
+		print_result(keys_name[keys], "insert", t_insert, loops);
+		print_result(keys_name[keys], "lookup", t_lookup, loops);
+		print_result(keys_name[keys], "erase", t_erase, loops);
+	}
 
-	init();
+	init(KEYS_RANDOM);
+	t_insert = t_erase = 0;
 
-	gettimeofday(&begin, NULL);
-	for (i = 0; i < PERF_LOOPS; i++) {
-		for (j = 0; j < NODES; j++)
+	for (i = 0; i < loops; i++) {
+		t = test_now();
+		for (j = 0; j < nr_nodes; j++)
 			insert_augmented(nodes + j, &root);
-		for (j = 0; j < NODES; j++)
+		t_insert += test_now() - t;
+
+		t = test_now();
+		for (j = 0; j < nr_nodes; j++)
 			erase_augmented(nodes + j, &root);
+		t_erase += test_now() - t;
+	}
+
+	print_result("random", "insert_augmented", t_insert, loops);
+	print_result("random", "erase_augmented", t_erase, loops);
+
+	return miss;
+}
+
+/*
+ * Fuzz. nodes[i] holds key 2 * i, so odd keys always miss.
+ * in_tree[i] is the model: whether nodes[i] is in the tree.
+ */
+static unsigned char in_tree[FUZZ_NODES];
+static int fuzz_count;
+
+static void fuzz_free(struct rb_node *rb, void *arg)
+{
+	struct test_node *node = rb_entry(rb, struct test_node, rb);
+
+	(void)arg;
+	in_tree[node - nodes] = 0;
+	fuzz_count--;
+}
+
+/*
+ * Throw the tree away and build a random subset of nodes by rb_build_sorted().
+ * Augmented values are then computed bottom up, children before parents.
+ */
+static void fuzz_rebuild(int augmented)
+{
+	struct rb_node *sorted[FUZZ_NODES], *rb;
+	struct test_node *node;
+	size_t nr = 0;
+	unsigned int i, keep = random() % 100;
+
+	rb_destroy(&root, fuzz_free, NULL);
+
+	for (i = 0; i < FUZZ_NODES; i++) {
+		if ((unsigned int)(random() % 100) < keep) {
+			sorted[nr++] = &nodes[i].rb;
+			in_tree[i] = 1;
+		}
+	}
+
+	rb_build_sorted(sorted, nr, &root);
+	fuzz_count = nr;
+
+	if (augmented) {
+		for (rb = rb_first_postorder(&root); rb; rb = rb_next_postorder(rb)) {
+			node = rb_entry(rb, struct test_node, rb);
+			node->augmented = augment_recompute(node);
+		}
 	}
+}
 
-	gettimeofday(&end, NULL);
+static int fuzz(int augmented, unsigned long ops)
+{
+	struct test_node *node;
+	unsigned long op;
+	unsigned int i, key;
+	int r;
 
-	tm = (end.tv_sec - begin.tv_sec) * 1000.0;
-	tm += (end.tv_usec - begin.tv_usec) / 1000.0;
-	printf(" -> %.0f ms / %.0f\n", (double)tm / PERF_LOOPS, tm);
+	memset(in_tree, 0, sizeof(in_tree));
+	fuzz_count = 0;
 
-	gettimeofday(&begin, NULL);
-	for (i = 0; i < CHECK_LOOPS; i++) {
-		init();
-		for (j = 0; j < NODES; j++) {
-			check_augmented(j);
-			insert_augmented(nodes + j, &root);
+	for (i = 0; i < FUZZ_NODES; i++) {
+		nodes[i].key = 2 * i;
+		nodes[i].val = random();
+	}
+
+	for (op = 0; op < ops; op++) {
+		r = random() % 1000;
+		i = random() % FUZZ_NODES;
+
+		if (r < 450) {
+			if (!in_tree[i]) {
+				if (augmented)
+					insert_augmented(nodes + i, &root);
+				else
+					insert(nodes + i, &root);
+				in_tree[i] = 1;
+				fuzz_count++;
+			}
+		} else if (r < 900) {
+			if (in_tree[i]) {
+				if (augmented)
+					erase_augmented(nodes + i, &root);
+				else
+					erase(nodes + i, &root);
+				in_tree[i] = 0;
+				fuzz_count--;
+			}
+		} else if (r < 999) {
+			key = random() % (2 * FUZZ_NODES);
+			node = lookup(&root, key);
+			CHECK(node == ((key & 1) || !in_tree[key / 2] ? NULL : nodes + key / 2));
+		} else {
+			fuzz_rebuild(augmented);
+			if (augmented ? check_augmented(fuzz_count) : check(fuzz_count))
+				return -1;
 		}
-		for (j = 0; j < NODES; j++) {
-			check_augmented(NODES - j);
-			erase_augmented(nodes + j, &root);
+
+		if (fuzz_count < FUZZ_SMALL || op % FUZZ_EVERY == 0) {
+			if (augmented ? check_augmented(fuzz_count) : check(fuzz_count))
+				return -1;
 		}
-		check_augmented(0);
 	}
-	gettimeofday(&end, NULL);
 
-	tm = (end.tv_sec - begin.tv_sec) * 1000.0;
-	tm += (end.tv_usec - begin.tv_usec) / 1000.0;
-	printf(" -> %.0f ms / %.0f\n", (double)tm / CHECK_LOOPS, tm);
+	rb_destroy(&root, fuzz_free, NULL);
+	CHECK(fuzz_count == 0);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int loops, seed;
+	unsigned long miss;
+
+	loops = bench_arg(argc, argv, 1, PERF_LOOPS);
+	nr_nodes = bench_arg(argc, argv, 2, NODES);
+	seed = bench_arg(argc, argv, 3, time(NULL));
+
+	if (loops == 0 || nr_nodes == 0)
+		return bench_usage(argv[0], "[perf_loops [nodes [seed]]]");
+
+	nodes = calloc(nr_nodes > FUZZ_NODES ? nr_nodes : FUZZ_NODES, sizeof(*nodes));
+	order = calloc(nr_nodes, sizeof(*order));
+	if (!nodes || !order)
+		return 1;
+
+	fprintf(stderr, "rbtree testing perf %u nodes %u seed %u\n", loops, nr_nodes, seed);
+	srandom(seed);
+
+	if (fuzz(0, FUZZ_OPS) || fuzz(1, FUZZ_OPS)) {
+		fprintf(stderr, "BUG: fuzz failed, seed %u\n", seed);
+		return 1;
+	}
+
+	miss = bench(loops);
+	if (miss) {
+		fprintf(stderr, "BUG: %lu lookups missed\n", miss);
+		return 1;
+	}
 
-	return 0; /* Fail will directly unload the module */
+	free(order);
+	free(nodes);
+	return 0;
 }
@@ -1,225 +1,428 @@
-/*!
- * \file ringbuf.c
- * \brief Implementation of ring buffer data structure.
- *
- * \date create: 2011/8/25
- * \author hac <Ping-Jhih Chen>
- * \sa ringbuf.h
- */
-
-
-/* generic */
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <string.h>
-#include <errno.h>
-#include <stdint.h>
-#include <assert.h>
-
-/* misc */
-#include <getopt.h>
-
-/* UNIX system call */
-#include <sys/types.h>
-#include <sys/stat.h>
-
-#include "ringbuf.h"
-
-
-/*!
- * \brief Reset/clean the ring content
- * \param ring The ring buffer to clean
- */
-extern void ringbuf_reset(ringbuf_t *ring)
-{
-	if (ring == NULL) return;
-
-	if (ring->container != NULL) {
-		memset(ring->container, 0x00, ring->size);
-	}
-
-	ring->needle = 0;
-}
-
-static void __buffer_init(ringbuf_t *ring, const int size)
-{
-	if (ring == NULL) return;
-
-	/* release old resource */
-	if (ring->container_buf != NULL) free(ring->container_buf);
-	if (ring->container != NULL) free(ring->container);
-
-	/* allocate new ring */
-	ring->container_buf = malloc(size + 1); // add one more byte for '\0' padding
-	assert(ring->container_buf != NULL);
-	memset(ring->container_buf, 0x00, size + 1);
-
-	ring->container = malloc(size + 1);
-	assert(ring->container != NULL);
-	memset(ring->container, 0x00, size + 1);
-
-	/* reset offset counter */
-	ring->size = size;
-	ring->needle = 0;
-}
-
-/*!
- * \brief Create a new ring buffer and initialize it.
- * \param size The max size of created ring buffer
- * \return A pointer to created ring buffer
- * \return NULL if error
- */
-extern ringbuf_t *ringbuf_create(const int size)
-{
-	ringbuf_t *ring;
-
-	ring = (ringbuf_t *) malloc(sizeof(*ring));
-	assert(ring != NULL);
-
-	memset(ring, 0x00, sizeof(*ring));
-
-	__buffer_init(ring, size);
-
-	return ring;
-}
-
-/*!
- * \brief Destroy a ring
- * \param ring The ring buffer to destroy
- * \sa ringbuf_create
- */
-extern void ringbuf_destroy(ringbuf_t *ring)
-{
-	if (ring == NULL) return;
-
-	if (ring->container_buf != NULL) free(ring->container_buf);
-	if (ring->container != NULL) free(ring->container);
-
-	return;
-}
-
-/*!
- * \brief Save input into the ring.
- * \param ring Input ring buffer
- * \param input New content to saved in ring buffer
- * \param input_len New content length (bytes)
- * \return >= 0 if ok
- * \return < 0 if error
- * \note Automatically rotate the ring iff. buffer overflow.
- */
-extern int ringbuf_input(ringbuf_t *ring, const char *input, int input_len)
-{
-	int delete_len = 0;
-
-	assert(ring != NULL);
-
-	if (input_len >= ring->size) {
-		/*
-		 * input overflow, copy newer input to container
-		 * (* WARNING: older input is lost)
-		 */
-		memcpy(ring->container, input + (input_len - ring->size), ring->size);
-
-		ring->needle = ring->size;
-	} else if (ring->needle + input_len > ring->size) {
-		/*
-		 * ring overflow, delete older container
-		 */
-		delete_len = (ring->needle + input_len) - ring->size;
-		assert(delete_len > 0);
-
-		/* copy newer content to buffer */
-		memset(ring->container_buf, 0x00, ring->size);
-		memcpy(ring->container_buf, ring->container + delete_len, ring->needle - delete_len);
-
-		/* clean ring */
-		memset(ring->container, 0x00, ring->size);
-
-		/* copy buffer content to ring container */
-		memcpy(ring->container, ring->container_buf, ring->needle - delete_len);
-		memcpy(ring->container + (ring->needle - delete_len), input, input_len);
-
-		ring->needle = (ring->needle + input_len) - delete_len;
-	} else {
-		/*
-		 * append new content to ring container directly
-		 */
-		memcpy(ring->container + ring->needle, input, input_len);
-
-		ring->needle += input_len;
-	}
-
-	return input_len;
-}
-
-/*!
- * \brief Rotate the ring buffer, i.e. delete older ring container & re-arrange the ring
- * \param ring Input ring buffer
- * \param rotate_len Rotate length (bytes)
- * \return Current used ring buffer size (i.e. needle offset)
- */
-extern int ringbuf_rotate(ringbuf_t *ring, int rotate_len)
-{
-	assert(ring != NULL);
-
-	if (rotate_len >= ring->needle) {
-		/*
-		 * delete all container
-		 */
-		memset(ring->container, 0x00, ring->size);
-		ring->needle = 0;
-	} else {
-		/* move reserved container to buffer */
-		memcpy(ring->container_buf, ring->container + rotate_len, ring->needle - rotate_len);
-
-		/* clean container */
-		memset(ring->container, 0x00, ring->size);
-
-		/* copy buffer to container */
-		memcpy(ring->container, ring->container_buf, ring->needle - rotate_len);
-
-		ring->needle -= rotate_len;
-	}
-
-	return ring->needle;
-}
-
-/*!
- * \brief Get current ring needle position i.e. current content size
- * \param ring Input ring buffer
- * \return The offset of ring needle
- * \note The offset is equal to current saved content size (bytes) 
- */
-extern int ringbuf_get_needle(ringbuf_t *ring)
-{
-	assert(ring != NULL);
-
-	return ring->needle;
-}
-
-/*!
- * \brief Get max size (bytes) of input ring buffer
- * \param ring Input ring buffer
- * \return Max ring buffer size (bytes)
- * \note Max size != currently used size
- */
-extern int ringbuf_get_size(ringbuf_t *ring)
-{
-	assert(ring != NULL);
-
-	return ring->size;
-}
-
-/*!
- * \brief Get the ring buffer
- * \param ring Ring buffer to fetch its container
- * \return A pointer to the container
- * \return NULL, otherwise
- */
-extern void *ringbuf_get_container(ringbuf_t *ring)
-{
-	assert(ring != NULL);
-
-	return (void *) ring->container;
-}
+/*!
+ * \file ringbuf.c
+ * \brief Implementation of ring buffer data structure.
+ *
+ * \date create: 2011/8/25
+ * \author hac <Ping-Jhih Chen>
+ * \sa ringbuf.h
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // memfd_create
+#endif
+
+/* generic */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <assert.h>
+
+/* misc */
+#include <getopt.h>
+
+/* UNIX system call */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "ringbuf.h"
+
+
+/*!
+ * \brief Reset/clean the ring content
+ * \param ring The ring buffer to clean
+ */
+extern void ringbuf_reset(ringbuf_t *ring)
+{
+	if (ring == NULL) return;
+
+	if (ring->container != NULL) {
+		memset(ring->container, 0x00, ring->size);
+	}
+
+	ring->needle = 0;
+	ring->head = 0;
+}
+
+static void __buffer_init(ringbuf_t *ring, const int size)
+{
+	if (ring == NULL) return;
+
+	/* release old resource */
+	if (ring->container_buf != NULL) free(ring->container_buf);
+	if (ring->container != NULL) free(ring->container);
+
+	/* allocate new ring */
+	ring->container_buf = malloc(size + 1); // add one more byte for '\0' padding
+	assert(ring->container_buf != NULL);
+	memset(ring->container_buf, 0x00, size + 1);
+
+	ring->container = malloc(size + 1);
+	assert(ring->container != NULL);
+	memset(ring->container, 0x00, size + 1);
+
+	/* reset offset counter */
+	ring->size = size;
+	ring->needle = 0;
+	ring->head = 0;
+}
+
+/*!
+ * \brief Create a new ring buffer and initialize it.
+ * \param size The max size of created ring buffer
+ * \return A pointer to created ring buffer
+ * \return NULL if error
+ */
+extern ringbuf_t *ringbuf_create(const int size)
+{
+	ringbuf_t *ring;
+
+	ring = (ringbuf_t *) malloc(sizeof(*ring));
+	assert(ring != NULL);
+
+	memset(ring, 0x00, sizeof(*ring));
+	ring->mirror_fd = -1;
+
+	__buffer_init(ring, size);
+
+	return ring;
+}
+
+/*!
+ * \brief Map the same memfd pages twice, back to back.
+ * \return 0 if ok
+ * \return < 0 if error
+ */
+static int __mirror_init(ringbuf_t *ring, const int size)
+{
+	void *base;
+	char *addr;
+	int fd;
+
+	fd = memfd_create("ringbuf", MFD_CLOEXEC);
+	if (fd < 0) return -1;
+
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	/* reserve 2 * size address space, then map fd over both halves */
+	base = mmap(NULL, 2 * (size_t) size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+
+	addr = (char *) base;
+	if (mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+		|| mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(base, 2 * (size_t) size);
+		close(fd);
+		return -1;
+	}
+
+	ring->container = base;
+	ring->container_buf = NULL;
+	ring->mirror_fd = fd;
+
+	ring->size = size;
+	ring->needle = 0;
+	ring->head = 0;
+
+	return 0;
+}
+
+/*!
+ * \brief Create a mirrored ring buffer.
+ * \param size The max size of created ring buffer. Round up to page size.
+ * \return A pointer to created ring buffer
+ * \return NULL if error
+ * \details The container is mapped twice back to back, so the content is
+ * always one contiguous region at ringbuf_get_container() without any copy,
+ * even when it wraps. ringbuf_read_fd()/ringbuf_write_fd() transfer the whole
+ * free/used space in one system call.
+ * \note The content is not '\0' terminated in this mode.
+ */
+extern ringbuf_t *ringbuf_create_mirror(const int size)
+{
+	ringbuf_t *ring;
+	long page;
+	int real_size;
+
+	if (size <= 0) return NULL;
+
+	page = sysconf(_SC_PAGESIZE);
+	if (page <= 0) page = 4096;
+
+	real_size = (int) (((size + page - 1) / page) * page);
+
+	ring = (ringbuf_t *) malloc(sizeof(*ring));
+	if (ring == NULL) return NULL;
+
+	memset(ring, 0x00, sizeof(*ring));
+	ring->mirror_fd = -1;
+
+	if (__mirror_init(ring, real_size) < 0) {
+		free(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+/*!
+ * \brief Destroy a ring
+ * \param ring The ring buffer to destroy
+ * \sa ringbuf_create
+ */
+extern void ringbuf_destroy(ringbuf_t *ring)
+{
+	if (ring == NULL) return;
+
+	if (ring->mirror_fd >= 0) {
+		munmap(ring->container, 2 * (size_t) ring->size);
+		close(ring->mirror_fd);
+
+		free(ring);
+		return;
+	}
+
+	if (ring->container_buf != NULL) free(ring->container_buf);
+	if (ring->container != NULL) free(ring->container);
+
+	free(ring);
+	return;
+}
+
+/*!
+ * \brief Copy data into the ring at a given offset, wrapping at the end.
+ */
+static void __ring_copy_in(ringbuf_t *ring, int offset, const char *input, int input_len)
+{
+	int first;
+
+	if (offset >= ring->size) offset -= ring->size;
+
+	if (ring->mirror_fd >= 0) {
+		/* the mirror takes care of wrapping */
+		memcpy((char *) ring->container + offset, input, input_len);
+		return;
+	}
+
+	first = ring->size - offset;
+	if (first >= input_len) {
+		memcpy((char *) ring->container + offset, input, input_len);
+	} else {
+		memcpy((char *) ring->container + offset, input, first);
+		memcpy(ring->container, input + first, input_len - first);
+	}
+}
+
+/*!
+ * \brief Save input into the ring.
+ * \param ring Input ring buffer
+ * \param input New content to saved in ring buffer
+ * \param input_len New content length (bytes)
+ * \return >= 0 if ok
+ * \return < 0 if error
+ * \note Automatically rotate the ring iff. buffer overflow.
+ */
+extern int ringbuf_input(ringbuf_t *ring, const char *input, int input_len)
+{
+	int delete_len = 0;
+
+	assert(ring != NULL);
+
+	if (input_len >= ring->size) {
+		/*
+		 * input overflow, copy newer input to container
+		 * (* WARNING: older input is lost)
+		 */
+		memcpy(ring->container, input + (input_len - ring->size), ring->size);
+
+		ring->head = 0;
+		ring->needle = ring->size;
+	} else {
+		if (ring->needle + input_len > ring->size) {
+			/*
+			 * ring overflow, delete older container by moving head only
+			 */
+			delete_len = (ring->needle + input_len) - ring->size;
+			assert(delete_len > 0);
+
+			ringbuf_rotate(ring, delete_len);
+		}
+
+		/*
+		 * append new content after the ring tail (may wrap)
+		 */
+		__ring_copy_in(ring, ring->head + ring->needle, input, input_len);
+
+		ring->needle += input_len;
+	}
+
+	return input_len;
+}
+
+/*!
+ * \brief Rotate the ring buffer, i.e. delete older ring container
+ * \param ring Input ring buffer
+ * \param rotate_len Rotate length (bytes)
+ * \return Current used ring buffer size (i.e. needle offset)
+ * \note O(1). Only the head offset moves.
+ */
+extern int ringbuf_rotate(ringbuf_t *ring, int rotate_len)
+{
+	assert(ring != NULL);
+
+	if (rotate_len >= ring->needle) {
+		/*
+		 * delete all container
+		 */
+		ring->head = 0;
+		ring->needle = 0;
+	} else {
+		ring->head += rotate_len;
+		if (ring->head >= ring->size) ring->head -= ring->size;
+
+		ring->needle -= rotate_len;
+	}
+
+	return ring->needle;
+}
+
+/*!
+ * \brief Get current ring needle position i.e. current content size
+ * \param ring Input ring buffer
+ * \return The offset of ring needle
+ * \note The offset is equal to current saved content size (bytes) 
+ */
+extern int ringbuf_get_needle(ringbuf_t *ring)
+{
+	assert(ring != NULL);
+
+	return ring->needle;
+}
+
+/*!
+ * \brief Get max size (bytes) of input ring buffer
+ * \param ring Input ring buffer
+ * \return Max ring buffer size (bytes)
+ * \note Max size != currently used size
+ */
+extern int ringbuf_get_size(ringbuf_t *ring)
+{
+	assert(ring != NULL);
+
+	return ring->size;
+}
+
+/*!
+ * \brief Get the ring content as one contiguous, '\0' terminated region
+ * \param ring Ring buffer to fetch its container
+ * \return A pointer to the oldest content
+ * \return NULL, otherwise
+ * \note Wrapped content is linearized here, i.e. the cost is paid only when
+ * a caller asks for the contiguous view. The pointer is valid until the next
+ * ringbuf_input() or ringbuf_rotate().
+ */
+extern void *ringbuf_get_container(ringbuf_t *ring)
+{
+	int first;
+	void *swap;
+
+	assert(ring != NULL);
+
+	if (ring->mirror_fd >= 0) {
+		return (char *) ring->container + ring->head;
+	}
+
+	if (ring->head + ring->needle > ring->size) {
+		/* wrapped, copy both parts into buffer and swap it in */
+		first = ring->size - ring->head;
+
+		memcpy(ring->container_buf, (char *) ring->container + ring->head, first);
+		memcpy((char *) ring->container_buf + first, ring->container, ring->needle - first);
+
+		swap = ring->container;
+		ring->container = ring->container_buf;
+		ring->container_buf = swap;
+
+		ring->head = 0;
+	}
+
+	/* the byte after tail is always unused (or the extra padding byte) */
+	((char *) ring->container)[ring->head + ring->needle] = '\0';
+
+	return (char *) ring->container + ring->head;
+}
+
+/*!
+ * \brief read(2) from fd into the ring free space without intermediate copy
+ * \param ring Input ring buffer
+ * \param fd File descriptor to read
+ * \return Return value of read(2)
+ * \return -1 with errno ENOBUFS if the ring is full
+ * \note A normal ring reads up to the container end. A mirrored ring reads all free space at once.
+ */
+extern ssize_t ringbuf_read_fd(ringbuf_t *ring, int fd)
+{
+	int tail, len;
+	ssize_t ret;
+
+	assert(ring != NULL);
+
+	len = ring->size - ring->needle;
+	if (len == 0) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	tail = ring->head + ring->needle;
+	if (tail >= ring->size) tail -= ring->size;
+
+	if (ring->mirror_fd < 0 && tail + len > ring->size) {
+		len = ring->size - tail;
+	}
+
+	ret = read(fd, (char *) ring->container + tail, len);
+	if (ret > 0) {
+		ring->needle += (int) ret;
+	}
+
+	return ret;
+}
+
+/*!
+ * \brief write(2) the ring content to fd and rotate what the kernel accepted
+ * \param ring Input ring buffer
+ * \param fd File descriptor to write
+ * \return Return value of write(2)
+ * \note A normal ring writes up to the container end. A mirrored ring writes all content at once.
+ */
+extern ssize_t ringbuf_write_fd(ringbuf_t *ring, int fd)
+{
+	int len;
+	ssize_t ret;
+
+	assert(ring != NULL);
+
+	len = ring->needle;
+	if (len == 0) return 0;
+
+	if (ring->mirror_fd < 0 && ring->head + len > ring->size) {
+		len = ring->size - ring->head;
+	}
+
+	ret = write(fd, (char *) ring->container + ring->head, len);
+	if (ret > 0) {
+		ringbuf_rotate(ring, (int) ret);
+	}
+
+	return ret;
+}
@@ -0,0 +1,397 @@
+/*!
+ * \file ringbuf_lf.c
+ * \brief Lock-free circular byte ring for producer/consumer threads.
+ *
+ * \sa ringbuf_lf.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sched.h>
+
+#include "ringbuf_lf.h"
+#include "atomic/atomic.h"
+
+/*
+ * Claim by CAS on a head index. atomic_try_cmpxchg() takes an atomic_t, whose
+ * int counter would make the free-running index arithmetic overflow signed.
+ */
+#define lf_cas_relaxed(_p, _old, _new) \
+	__atomic_compare_exchange_n((_p), (_old), (_new), 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define lf_cpu_relax() __builtin_ia32_pause()
+#else
+#define lf_cpu_relax() __asm__ __volatile__ ("" : : : "memory")
+#endif
+
+/*
+ * Spin this many times waiting for an earlier thread to publish, then give up
+ * the cpu. The earlier thread might have been preempted in its copy.
+ *
+ * The load is acquire: the release store which follows only carries what this
+ * thread has seen, so the earlier thread's copy must be acquired here for a
+ * later reader (or overwriter) of the region to see it too.
+ */
+#define LF_SPIN_MAX (1024)
+
+#define lf_wait_turn(_p, _turn) \
+	do { \
+		unsigned int __spin = 0; \
+		while (smp_load_acquire(_p) != (_turn)) \
+		{ \
+			if (++__spin < LF_SPIN_MAX) \
+			{ \
+				lf_cpu_relax(); \
+			} \
+			else \
+			{ \
+				__spin = 0; \
+				sched_yield(); \
+			} \
+		} \
+	} while (0)
+
+static inline unsigned int pow2_adjust(unsigned int x)
+{
+	x--;
+	x |= x >> 1;
+	x |= x >> 2;
+	x |= x >> 4;
+	x |= x >> 8;
+	x |= x >> 16;
+
+	return (x + 1);
+}
+
+/*!
+ * \brief Init a ring.
+ * \param ring The ring to init
+ * \param size Ring size (bytes). Round up to a power of 2.
+ * \return 0 if ok
+ * \return < 0 if error
+ */
+extern int ringbuf_lf_init(ringbuf_lf_t *ring, const unsigned int size)
+{
+	assert(ring != NULL);
+
+	if (size == 0 || size > (1U << 31))
+	{
+		return -1;
+	}
+
+	memset(ring, 0x00, sizeof(*ring));
+
+	ring->size = pow2_adjust(size);
+	ring->mask = ring->size - 1;
+
+	ring->buf = malloc(ring->size);
+	if (ring->buf == NULL)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Release ring storage.
+ * \sa ringbuf_lf_init
+ */
+extern void ringbuf_lf_exit(ringbuf_lf_t *ring)
+{
+	if (ring == NULL) return;
+
+	free(ring->buf);
+	ring->buf = NULL;
+}
+
+/*!
+ * \brief Create a new ring and initialize it.
+ * \param size Ring size (bytes). Round up to a power of 2.
+ * \return A pointer to created ring
+ * \return NULL if error
+ */
+extern ringbuf_lf_t *ringbuf_lf_create(const unsigned int size)
+{
+	ringbuf_lf_t *ring;
+
+	if (posix_memalign((void **) &ring, RINGBUF_LF_CACHELINE, sizeof(*ring)))
+	{
+		return NULL;
+	}
+
+	if (ringbuf_lf_init(ring, size) < 0)
+	{
+		free(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+/*!
+ * \brief Destroy a ring
+ * \sa ringbuf_lf_create
+ */
+extern void ringbuf_lf_destroy(ringbuf_lf_t *ring)
+{
+	if (ring == NULL) return;
+
+	ringbuf_lf_exit(ring);
+	free(ring);
+}
+
+/*!
+ * \brief Get published bytes. (A hint if other threads are running)
+ */
+extern unsigned int ringbuf_lf_get_used(ringbuf_lf_t *ring)
+{
+	return smp_load_acquire(&ring->prod.tail) - smp_load_acquire(&ring->cons.tail);
+}
+
+/*!
+ * \brief Get free bytes. (A hint if other threads are running)
+ */
+extern unsigned int ringbuf_lf_get_free(ringbuf_lf_t *ring)
+{
+	return ring->size - ringbuf_lf_get_used(ring);
+}
+
+static inline void ring_copy_in(ringbuf_lf_t *ring, const unsigned int pos, const uint8_t *data, const unsigned int len)
+{
+	unsigned int off = pos & ring->mask;
+	unsigned int first = ring->size - off;
+
+	if (first >= len)
+	{
+		memcpy(ring->buf + off, data, len);
+	}
+	else
+	{
+		memcpy(ring->buf + off, data, first);
+		memcpy(ring->buf, data + first, len - first);
+	}
+}
+
+static inline void ring_copy_out(ringbuf_lf_t *ring, const unsigned int pos, uint8_t *buf, const unsigned int len)
+{
+	unsigned int off = pos & ring->mask;
+	unsigned int first = ring->size - off;
+
+	if (first >= len)
+	{
+		memcpy(buf, ring->buf + off, len);
+	}
+	else
+	{
+		memcpy(buf, ring->buf + off, first);
+		memcpy(buf + first, ring->buf, len - first);
+	}
+}
+
+/*!
+ * \brief Write as many bytes as possible. (single producer)
+ * \return Number of bytes written
+ */
+extern unsigned int ringbuf_lf_sp_write(ringbuf_lf_t *ring, const void *data, const unsigned int len)
+{
+	unsigned int tail, space, n;
+
+	tail = READ_ONCE(ring->prod.tail);
+	space = ring->size - (tail - smp_load_acquire(&ring->cons.tail));
+
+	n = (len < space) ? len : space;
+	if (n == 0)
+	{
+		return 0;
+	}
+
+	ring_copy_in(ring, tail, (const uint8_t *) data, n);
+
+	WRITE_ONCE(ring->prod.head, tail + n);
+	smp_store_release(&ring->prod.tail, tail + n);
+
+	return n;
+}
+
+/*!
+ * \brief Read as many bytes as possible. (single consumer)
+ * \return Number of bytes read
+ */
+extern unsigned int ringbuf_lf_sc_read(ringbuf_lf_t *ring, void *buf, const unsigned int len)
+{
+	unsigned int head, avail, n;
+
+	head = READ_ONCE(ring->cons.tail);
+	avail = smp_load_acquire(&ring->prod.tail) - head;
+
+	n = (len < avail) ? len : avail;
+	if (n == 0)
+	{
+		return 0;
+	}
+
+	ring_copy_out(ring, head, (uint8_t *) buf, n);
+
+	WRITE_ONCE(ring->cons.head, head + n);
+	smp_store_release(&ring->cons.tail, head + n);
+
+	return n;
+}
+
+/*!
+ * \brief Get the contiguous free span at ring tail to write in place. (single producer)
+ * \param ring Input ring
+ * \param ptr Output pointer to the span
+ * \return Span length (bytes). 0 if ring is full.
+ * \sa ringbuf_lf_sp_commit
+ */
+extern unsigned int ringbuf_lf_sp_reserve(ringbuf_lf_t *ring, void **ptr)
+{
+	unsigned int tail, space, off;
+
+	tail = READ_ONCE(ring->prod.tail);
+	space = ring->size - (tail - smp_load_acquire(&ring->cons.tail));
+
+	off = tail & ring->mask;
+	if (space > ring->size - off)
+	{
+		space = ring->size - off;
+	}
+
+	*ptr = ring->buf + off;
+	return space;
+}
+
+/*!
+ * \brief Publish len bytes written in the reserved span. (single producer)
+ * \sa ringbuf_lf_sp_reserve
+ */
+extern void ringbuf_lf_sp_commit(ringbuf_lf_t *ring, const unsigned int len)
+{
+	unsigned int tail = READ_ONCE(ring->prod.tail);
+
+	WRITE_ONCE(ring->prod.head, tail + len);
+	smp_store_release(&ring->prod.tail, tail + len);
+}
+
+/*!
+ * \brief Get the contiguous published span at ring head to read in place. (single consumer)
+ * \param ring Input ring
+ * \param ptr Output pointer to the span
+ * \return Span length (bytes). 0 if ring is empty.
+ * \sa ringbuf_lf_sc_consume
+ */
+extern unsigned int ringbuf_lf_sc_peek(ringbuf_lf_t *ring, const void **ptr)
+{
+	unsigned int head, avail, off;
+
+	head = READ_ONCE(ring->cons.tail);
+	avail = smp_load_acquire(&ring->prod.tail) - head;
+
+	off = head & ring->mask;
+	if (avail > ring->size - off)
+	{
+		avail = ring->size - off;
+	}
+
+	*ptr = ring->buf + off;
+	return avail;
+}
+
+/*!
+ * \brief Release len bytes read in place. (single consumer)
+ * \sa ringbuf_lf_sc_peek
+ */
+extern void ringbuf_lf_sc_consume(ringbuf_lf_t *ring, const unsigned int len)
+{
+	unsigned int head = READ_ONCE(ring->cons.tail);
+
+	WRITE_ONCE(ring->cons.head, head + len);
+	smp_store_release(&ring->cons.tail, head + len);
+}
+
+/*!
+ * \brief Write all bytes or nothing. (multi producer)
+ * \return len if ok
+ * \return 0 if there is not enough space
+ */
+extern unsigned int ringbuf_lf_mp_write(ringbuf_lf_t *ring, const void *data, const unsigned int len)
+{
+	unsigned int head, next;
+
+	if (len == 0 || len > ring->size)
+	{
+		return 0;
+	}
+
+	/*
+	 * Claim [head, next) against the published consumer tail.
+	 */
+	head = READ_ONCE(ring->prod.head);
+	do
+	{
+		if (ring->size - (head - smp_load_acquire(&ring->cons.tail)) < len)
+		{
+			return 0;
+		}
+
+		next = head + len;
+	} while (!lf_cas_relaxed(&ring->prod.head, &head, next));
+
+	ring_copy_in(ring, head, (const uint8_t *) data, len);
+
+	/*
+	 * Publish in claim order. Wait for earlier producers to finish.
+	 */
+	lf_wait_turn(&ring->prod.tail, head);
+
+	smp_store_release(&ring->prod.tail, next);
+
+	return len;
+}
+
+/*!
+ * \brief Read as many bytes as possible. (multi consumer)
+ * \return Number of bytes read
+ */
+extern unsigned int ringbuf_lf_mc_read(ringbuf_lf_t *ring, void *buf, const unsigned int len)
+{
+	unsigned int head, next, avail, n;
+
+	if (len == 0)
+	{
+		return 0;
+	}
+
+	/*
+	 * Claim [head, next) against the published producer tail.
+	 */
+	head = READ_ONCE(ring->cons.head);
+	do
+	{
+		avail = smp_load_acquire(&ring->prod.tail) - head;
+		if (avail == 0)
+		{
+			return 0;
+		}
+
+		n = (len < avail) ? len : avail;
+		next = head + n;
+	} while (!lf_cas_relaxed(&ring->cons.head, &head, next));
+
+	ring_copy_out(ring, head, (uint8_t *) buf, n);
+
+	/*
+	 * Release in claim order. Wait for earlier consumers to finish.
+	 */
+	lf_wait_turn(&ring->cons.tail, head);
+
+	smp_store_release(&ring->cons.tail, next);
+
+	return n;
+}
@@ -0,0 +1,78 @@
+/*!
+ * \file ringbuf_lf.h
+ * \brief Lock-free circular byte ring for producer/consumer threads.
+ *
+ * \details
+ * Unlike ringbuf_t, the ring never moves data. Producer and consumer
+ * own a free-running head/tail pair each and publish their progress with
+ * acquire/release ordering, so bytes are exchanged without locks.
+ *
+ * - sp/sc: single producer/single consumer. Writes and reads may be partial.
+ *   reserve/commit and peek/consume give zero-copy access to the ring.
+ * - mp/mc: bounded multi producer/multi consumer. Each thread claims a
+ *   region by CAS on head, copies, then publishes tail in claim order.
+ *   mp writes are all-or-nothing so that messages are never torn.
+ *
+ * Do not mix sp/mp (or sc/mc) calls on one ring at the same time.
+ *
+ * \par Example:
+ * \code
+ringbuf_lf_t *ring = ringbuf_lf_create(65536);
+
+// producer thread
+ringbuf_lf_sp_write(ring, data, data_len);
+
+// consumer thread
+n = ringbuf_lf_sc_read(ring, buf, sizeof(buf));
+ * \endcode
+ */
+
+#ifndef RINGBUF_LF_H_
+#define RINGBUF_LF_H_
+
+#include <stdint.h>
+
+#define RINGBUF_LF_CACHELINE (64)
+
+/*!
+ * \brief A head/tail index pair. (free running, wrap by mask)
+ */
+struct ringbuf_lf_headtail
+{
+	volatile unsigned int head; //!< Claimed position.
+	volatile unsigned int tail; //!< Published position.
+} __attribute__((aligned(RINGBUF_LF_CACHELINE)));
+
+/*!
+ * \brief Lock-free ring buffer structure.
+ */
+typedef struct ringbuf_lf
+{
+	uint8_t *buf; //!< ring storage
+	unsigned int size; //!< ring size. Always a power of 2.
+	unsigned int mask; //!< size - 1
+
+	struct ringbuf_lf_headtail prod; //!< Written by producers.
+	struct ringbuf_lf_headtail cons; //!< Written by consumers.
+} ringbuf_lf_t;
+
+extern int ringbuf_lf_init(ringbuf_lf_t *ring, const unsigned int size);
+extern void ringbuf_lf_exit(ringbuf_lf_t *ring);
+extern ringbuf_lf_t *ringbuf_lf_create(const unsigned int size);
+extern void ringbuf_lf_destroy(ringbuf_lf_t *ring);
+
+extern unsigned int ringbuf_lf_get_used(ringbuf_lf_t *ring);
+extern unsigned int ringbuf_lf_get_free(ringbuf_lf_t *ring);
+
+extern unsigned int ringbuf_lf_sp_write(ringbuf_lf_t *ring, const void *data, const unsigned int len);
+extern unsigned int ringbuf_lf_sc_read(ringbuf_lf_t *ring, void *buf, const unsigned int len);
+
+extern unsigned int ringbuf_lf_sp_reserve(ringbuf_lf_t *ring, void **ptr);
+extern void ringbuf_lf_sp_commit(ringbuf_lf_t *ring, const unsigned int len);
+extern unsigned int ringbuf_lf_sc_peek(ringbuf_lf_t *ring, const void **ptr);
+extern void ringbuf_lf_sc_consume(ringbuf_lf_t *ring, const unsigned int len);
+
+extern unsigned int ringbuf_lf_mp_write(ringbuf_lf_t *ring, const void *data, const unsigned int len);
+extern unsigned int ringbuf_lf_mc_read(ringbuf_lf_t *ring, void *buf, const unsigned int len);
+
+#endif /* RINGBUF_LF_H_ */
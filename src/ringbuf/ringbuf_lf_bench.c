@@ -0,0 +1,274 @@
+/*
+ * ringbuf_lf stress and throughput benchmark.
+ *
+ * Usage: ringbuf_lf_bench [records [max_threads | producers consumers]]
+ *
+ * RECORDS fixed-size records are passed from producer to consumer threads
+ * through a small ring, so that it wraps and fills all the time. sp_write and
+ * sc_read run with 1 producer and 1 consumer; mp_write and mc_read run with
+ * 1:1, n:n, n:1 and 1:n threads for n = 2, 4, ... up to max_threads. Given
+ * producers and consumers, only that point is run.
+ *
+ * Every write and read is a multiple of the record size, so records are never
+ * split between consumers. Every record is checked to arrive exactly once and
+ * intact, and in order per producer when there is a single consumer.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "bench.h"
+#include "atomic/atomic.h"
+#include "ringbuf_lf.h"
+
+#define RECORDS     (1 << 20)
+#define MAX_THREADS 16
+#define RING_SIZE   4096
+#define READ_BATCH  8 //!< Records per read
+#define SPIN_MAX    64 //!< Retries on a full or empty ring before yielding the cpu
+
+enum { MODE_SPSC, MODE_MPMC, MODE_MAX };
+
+static const char *mode_name[MODE_MAX] = { "spsc", "mpmc" };
+
+struct bench_record
+{
+	uint32_t producer;
+	uint32_t seq; //!< Position in its producer's sequence
+	uint64_t check; //!< Derived from producer and seq, to catch torn records
+};
+
+static ringbuf_lf_t *ring;
+static unsigned long nr_records;
+
+static int mode;
+static unsigned int nr_prod, nr_cons;
+
+static pthread_barrier_t start;
+static atomic64_t consumed;
+static atomic64_t errors;
+static atomic_t *seen; //!< Per record: 0 until consumed once
+
+static inline uint64_t record_check(const uint32_t producer, const uint32_t seq)
+{
+	return ((uint64_t) producer << 32 | seq) * 0x9e3779b97f4a7c15ULL;
+}
+
+static inline void bench_backoff(unsigned int *spin)
+{
+	if (++(*spin) >= SPIN_MAX)
+	{
+		*spin = 0;
+		sched_yield();
+	}
+}
+
+static void *producer(void *arg)
+{
+	uint32_t id = (uintptr_t) arg, seq = 0;
+	struct bench_record rec;
+	unsigned long i;
+	unsigned int spin = 0, n;
+
+	pthread_barrier_wait(&start);
+
+	/* Producer id owns records id, id + nr_prod, ... */
+	for (i = id; i < nr_records; i += nr_prod, seq++)
+	{
+		rec.producer = id;
+		rec.seq = seq;
+		rec.check = record_check(id, seq);
+
+		for (;;)
+		{
+			if (mode == MODE_SPSC)
+				n = ringbuf_lf_sp_write(ring, &rec, sizeof(rec));
+			else
+				n = ringbuf_lf_mp_write(ring, &rec, sizeof(rec));
+
+			if (n == sizeof(rec))
+				break;
+
+			/* sp_write may be partial: a full ring must leave whole records free. */
+			if (n != 0)
+			{
+				(void) atomic64_add_return_relaxed(1, &errors);
+				return NULL;
+			}
+
+			bench_backoff(&spin);
+		}
+	}
+
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	struct bench_record rec[READ_BATCH];
+	uint32_t last[MAX_THREADS] = { 0 };
+	unsigned int spin = 0, n, i;
+	long err = 0;
+
+	(void) arg;
+
+	pthread_barrier_wait(&start);
+
+	while ((unsigned long) atomic64_read(&consumed) < nr_records)
+	{
+		if (mode == MODE_SPSC)
+			n = ringbuf_lf_sc_read(ring, rec, sizeof(rec));
+		else
+			n = ringbuf_lf_mc_read(ring, rec, sizeof(rec));
+
+		if (n == 0)
+		{
+			bench_backoff(&spin);
+			continue;
+		}
+
+		spin = 0;
+		if (n % sizeof(rec[0]))
+		{
+			/* Torn: nothing after this can be trusted. */
+			(void) atomic64_add_return_relaxed(1, &errors);
+			atomic64_set(&consumed, nr_records);
+			break;
+		}
+
+		n /= sizeof(rec[0]);
+		for (i = 0; i < n; i++)
+		{
+			if (rec[i].producer >= nr_prod || rec[i].check != record_check(rec[i].producer, rec[i].seq))
+			{
+				err++;
+				continue;
+			}
+
+			err += (atomic_xchg_relaxed(&seen[(unsigned long) rec[i].seq * nr_prod + rec[i].producer], 1) != 0);
+
+			/* Both rings are FIFO; only one consumer can observe it. */
+			if (nr_cons == 1)
+			{
+				err += (rec[i].seq != last[rec[i].producer]);
+				last[rec[i].producer] = rec[i].seq + 1;
+			}
+		}
+
+		(void) atomic64_add_return_relaxed(n, &consumed);
+	}
+
+	(void) atomic64_add_return_relaxed(err, &errors);
+	return NULL;
+}
+
+static void run(const int m, const unsigned int prod, const unsigned int cons)
+{
+	pthread_t th[2 * MAX_THREADS];
+	unsigned int i, n = 0;
+	unsigned long j;
+	uint64_t t;
+
+	mode = m;
+	nr_prod = prod;
+	nr_cons = cons;
+	atomic64_set(&consumed, 0);
+
+	for (j = 0; j < nr_records; j++)
+	{
+		atomic_set(&seen[j], 0);
+	}
+
+	pthread_barrier_init(&start, NULL, prod + cons + 1);
+
+	for (i = 0; i < prod; i++)
+		if (pthread_create(&th[n], NULL, producer, (void *) (uintptr_t) i) == 0)
+			n++;
+	for (i = 0; i < cons; i++)
+		if (pthread_create(&th[n], NULL, consumer, NULL) == 0)
+			n++;
+
+	if (n != prod + cons)
+	{
+		fprintf(stderr, "Cannot create threads\n");
+		exit(1);
+	}
+
+	pthread_barrier_wait(&start);
+	t = bench_now_ns();
+
+	for (i = 0; i < n; i++)
+		pthread_join(th[i], NULL);
+
+	t = bench_now_ns() - t;
+	pthread_barrier_destroy(&start);
+
+	printf("%s,%u,%u,%lu,%.2f\n", mode_name[m], prod, cons, nr_records, (double) nr_records * 1000.0 / t);
+
+	for (j = 0; j < nr_records; j++)
+	{
+		if (atomic_read(&seen[j]) != 1)
+			(void) atomic64_add_return_relaxed(1, &errors);
+	}
+
+	/* Leave the ring empty for the next run. */
+	if (ringbuf_lf_get_used(ring))
+		(void) atomic64_add_return_relaxed(1, &errors);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int max_threads, cons, n;
+
+	nr_records = bench_arg(argc, argv, 1, RECORDS);
+	max_threads = bench_arg(argc, argv, 2, MAX_THREADS);
+	cons = bench_arg(argc, argv, 3, 0);
+	if (nr_records == 0 || nr_records > UINT32_MAX || max_threads == 0 || max_threads > MAX_THREADS
+		|| cons > MAX_THREADS || (argc > 3 && cons == 0))
+	{
+		return bench_usage(argv[0], "[records [max_threads | producers consumers]] (threads 1 to " BENCH_STR(MAX_THREADS) ")");
+	}
+
+	seen = calloc(nr_records, sizeof(*seen));
+	ring = ringbuf_lf_create(RING_SIZE);
+	if (seen == NULL || ring == NULL)
+	{
+		return 1;
+	}
+
+	printf("ring,producers,consumers,records,mops_per_sec\n");
+
+	if (cons)
+	{
+		if (max_threads == 1 && cons == 1)
+			run(MODE_SPSC, 1, 1);
+		run(MODE_MPMC, max_threads, cons);
+	}
+	else
+	{
+		run(MODE_SPSC, 1, 1);
+		for (n = 1; n <= max_threads; n *= 2)
+		{
+			run(MODE_MPMC, n, n);
+			if (n > 1)
+			{
+				run(MODE_MPMC, n, 1);
+				run(MODE_MPMC, 1, n);
+			}
+		}
+	}
+
+	ringbuf_lf_destroy(ring);
+	free(seen);
+
+	if (atomic64_read(&errors))
+	{
+		fprintf(stderr, "BUG: %ld records lost, duplicated, torn or out of order\n", (long) atomic64_read(&errors));
+		return 1;
+	}
+
+	return 0;
+}